@@ -0,0 +1,114 @@
+#include <stdexcept>
+#include <vector>
+#include <benchmark/benchmark.h>
+#include <opcode/parser.h>
+
+#define private public
+#include <chip8.h>
+
+namespace {
+    // Open forever and never pressed, so LD Vx, K keeps waiting
+    class TIdleInput : public IInputSource {
+    public:
+        void Poll(uint64_t, TPendingKeys&) override {
+        }
+
+        bool IsOpen() const override {
+            return true;
+        }
+    };
+
+    // ADD, ALU ops, CALL/RET and a skip in a loop that never ends
+    const uint8_t AluLoop[] = {
+        0x70, 0x01, 0x81, 0x04, 0x82, 0x13, 0x83, 0x25, 0x22, 0x10,
+        0x30, 0x00, 0x12, 0x00, 0x12, 0x00, 0x84, 0x06, 0x00, 0xEE,
+    };
+
+    void LoadProgram(TChip8Machine& machine, const uint8_t* program, size_t size) {
+        std::copy(program, program + size, machine.State.Memory.begin() + 0x200);
+    }
+}
+
+static void BM_Parse(benchmark::State& state) {
+    for (auto _ : state) {
+        for (uint32_t word = 0; word <= 0xFFFF; ++word) {
+            benchmark::DoNotOptimize(TOpcodeParser::Parse(word));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * 0x10000);
+}
+BENCHMARK(BM_Parse);
+
+// Parse plus the handler lookup, over every word that is a valid instruction
+static void BM_Decode(benchmark::State& state) {
+    std::vector<uint16_t> words;
+    for (uint32_t word = 0; word <= 0xFFFF; ++word) {
+        try {
+            TChip8Machine::TCPU::Decode(word);
+            words.push_back(word);
+        } catch (const std::logic_error&) {
+        }
+    }
+    for (auto _ : state) {
+        for (const uint16_t word : words) {
+            benchmark::DoNotOptimize(TChip8Machine::TCPU::Decode(word));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * words.size());
+}
+BENCHMARK(BM_Decode);
+
+// Fetch, dispatch and execute of a short loop, per backend
+static void BM_Step(benchmark::State& state) {
+    TChip8Machine machine;
+    machine.SetCpuBackend(static_cast<TChip8Machine::ECpuBackend>(state.range(0)));
+    LoadProgram(machine, AluLoop, sizeof(AluLoop));
+    const uint64_t batch = 1000;
+    for (auto _ : state) {
+        machine.Cpu.Run(batch);
+    }
+    state.SetItemsProcessed(state.iterations() * batch);
+}
+BENCHMARK(BM_Step)->ArgName("backend")
+    ->Arg(static_cast<int>(TChip8Machine::ECpuBackend::Dispatch))
+    ->Arg(static_cast<int>(TChip8Machine::ECpuBackend::Threaded))
+    ->Arg(static_cast<int>(TChip8Machine::ECpuBackend::Blocks));
+
+static void BM_Draw(benchmark::State& state) {
+    TChip8Machine machine;
+    machine.State.I = machine.State.GetSpriteAddr(8);
+    machine.State.V[1] = 13;
+    machine.State.V[2] = 7;
+    const TOpcode opcode = TOpcodeParser::Parse(0xD120 | state.range(0));
+    for (auto _ : state) {
+        machine.Cpu.Draw(opcode);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Draw)->ArgName("height")->Arg(1)->Arg(5)->Arg(8)->Arg(15);
+
+static void BM_ClearScreen(benchmark::State& state) {
+    TChip8Machine machine;
+    const TOpcode opcode = TOpcodeParser::Parse(0x00E0);
+    for (auto _ : state) {
+        machine.Cpu.ClearScreen(opcode);
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ClearScreen);
+
+// One LD Vx, K that finds no key: poll, rewind PC, and the timers keep running
+static void BM_WaitForKey(benchmark::State& state) {
+    TChip8Machine machine;
+    TIdleInput input;
+    machine.SetInputSource(&input);
+    const uint8_t program[] = {0xF0, 0x0A};
+    LoadProgram(machine, program, sizeof(program));
+    const uint64_t batch = 1000;
+    for (auto _ : state) {
+        machine.Run(batch);
+    }
+    state.SetItemsProcessed(state.iterations() * batch);
+}
+BENCHMARK(BM_WaitForKey);
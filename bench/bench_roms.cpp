@@ -0,0 +1,36 @@
+#include <string>
+#include <benchmark/benchmark.h>
+#include <chip8.h>
+
+// Whole programs from bench/roms run headless at full speed. maze.ch8 is David Winter's
+// public-domain Maze; alu, random and sprites are small loops written for these
+// benchmarks that lean on arithmetic, RND and DRW/CLS respectively.
+static void BM_Rom(benchmark::State& state, const char* rom) {
+    const uint64_t frames = 60 * 60 * 10;
+    uint64_t instructions = 0;
+    for (auto _ : state) {
+        state.PauseTiming();
+        TChip8Machine machine;
+        machine.SetCpuBackend(static_cast<TChip8Machine::ECpuBackend>(state.range(0)));
+        machine.SetSpeed(TChip8Machine::Unthrottled);
+        machine.SetRandomSeed(0);
+        machine.LoadGame(std::string(CHIP8_BENCH_ROMS) + "/" + rom);
+        state.ResumeTiming();
+
+        machine.Execute(frames);
+        instructions += machine.GetCycles();
+    }
+    state.counters["MIPS"] = benchmark::Counter(instructions / 1e6, benchmark::Counter::kIsRate);
+}
+
+#define CHIP8_BENCH_ROM(name) \
+    BENCHMARK_CAPTURE(BM_Rom, name, #name ".ch8")->ArgName("backend") \
+        ->Arg(static_cast<int>(TChip8Machine::ECpuBackend::Dispatch)) \
+        ->Arg(static_cast<int>(TChip8Machine::ECpuBackend::Threaded)) \
+        ->Arg(static_cast<int>(TChip8Machine::ECpuBackend::Blocks)) \
+        ->Unit(benchmark::kMillisecond);
+
+CHIP8_BENCH_ROM(maze)
+CHIP8_BENCH_ROM(alu)
+CHIP8_BENCH_ROM(random)
+CHIP8_BENCH_ROM(sprites)
@@ -1,91 +1,75 @@
 #include <ios>
+#include <cstring>
 #include <fstream>
-#include <iostream>
 #include <map>
 #include <sstream>
 #include <random>
-#include <SFML/Graphics/RectangleShape.hpp>
-#include <SFML/Window/Event.hpp>
-#include <SFML/Audio.hpp>
+#include <limits>
+#include <algorithm>
 
 #include <thread>
-#include <SFML/Graphics/Shader.hpp>
-#include <SFML/Window/Context.hpp>
 #include <utils/bitutils.h>
 #include "chip8.h"
 #include <opcode/types.h>
 #include <opcode/parser.h>
 
 namespace {
-    std::mutex videoMemoryAccess;
-    std::mutex delayTimerAccess;
-    std::mutex speakerTimerAccess;
-    std::mutex executionLock;
-
-    std::condition_variable keyEvent;
-
-    void DelayTimer(const sf::RenderWindow& screen, volatile uint8_t& timer) {
-        while(screen.isOpen()) {
-            {
-                std::lock_guard<std::mutex> lock(delayTimerAccess);
-                if (timer > 0) {
-                    timer--;
-                }
-            }
-
-            std::this_thread::sleep_for(std::chrono::milliseconds(1000/60));
-        }
-    }
-
-    void Speaker(const sf::RenderWindow& screen, volatile uint8_t& speaker) {
-        sf::SoundBuffer buffer;
-        buffer.loadFromFile("/Users/lognick/Downloads/440Hz_44100Hz_16bit_05sec.wav");
-        sf::Sound sound;
-        sound.setBuffer(buffer);
-        sound.setLoop(true);
+    // Every implemented operation with its TCPU handler, in EOperationType order so the
+    // threaded backend's label table can be indexed by the operation type
+#define CHIP8_OPERATIONS(XX) \
+    XX(CLS, ClearScreen) \
+    XX(RET, Return) \
+    XX(JUMP, Jump) \
+    XX(CALL, Call) \
+    XX(SE_CONST, SkipIfEqualToConst) \
+    XX(SE_KEY, SkipIfEqualToKey) \
+    XX(SNE_KEY, SkipIfNotEqualToKey) \
+    XX(SNE_CONST, SkipIfNotEqualToConst) \
+    XX(SE_VAR, SkipIfEqualToVar) \
+    XX(LD_CONST, LoadConst) \
+    XX(ADD_CONST, AddConst) \
+    XX(LD_VAR, LoadVar) \
+    XX(OR_VAR, OrWithVar) \
+    XX(AND_VAR, AndWithVar) \
+    XX(XOR_VAR, XorWithVar) \
+    XX(ADD_VAR, AddWithVar) \
+    XX(SUB_VAR, SubWithVar) \
+    XX(SHR_VAR, ShrWithVar) \
+    XX(SUBN_VAR, SubnWithVar) \
+    XX(SHL_VAR, ShlWithVar) \
+    XX(SNE_VAR, SkipIfNotEqualToVar) \
+    XX(LD_ADDR, LoadAddr) \
+    XX(RND, Random) \
+    XX(DRAW, Draw) \
+    XX(LD_ST, LoadSpeakerTimer) \
+    XX(LD_DT, LoadDelayTimer) \
+    XX(LD_KEY, LoadKey) \
+    XX(ADD_ADDR, AddWithAddr) \
+    XX(LD_MEM, LoadMemory) \
+    XX(STORE_DT, StoreDelayTimer) \
+    XX(STORE_ST, StoreSpeakerTimer) \
+    XX(LD_SPRITE, LoadSprite) \
+    XX(STORE_MEM, StoreMemory) \
+    XX(STORE_BCD_VAR, StoreBCDVar)
+
+    constexpr EOperationType ImplementedOperations[] = {
+#define CHIP8_TYPE(type, handler) EOperationType::type,
+        CHIP8_OPERATIONS(CHIP8_TYPE)
+#undef CHIP8_TYPE
+    };
 
-        while(screen.isOpen()) {
-            {
-                std::lock_guard<std::mutex> lock(speakerTimerAccess);
-                if (speaker > 0) {
-                    sound.play();
-                    speaker--;
-                }
-                else {
-                    sound.stop();
-                }
+    constexpr bool ListsOperationsInOrder() {
+        for (size_t i = 0; i < sizeof(ImplementedOperations) / sizeof(ImplementedOperations[0]); ++i) {
+            if (static_cast<size_t>(ImplementedOperations[i]) != i + 1) {
+                return false;
             }
-
-            std::this_thread::sleep_for(std::chrono::milliseconds(1000/60));
         }
+        return sizeof(ImplementedOperations) / sizeof(ImplementedOperations[0]) + 1 == OperationTypesCount;
     }
 
-    void Render(sf::RenderWindow& screen, const TChip8Machine::TVideoMemory& videoMemory) {
-        while (screen.isOpen()) {
-            screen.clear();
-            for (size_t x = 0; x < videoMemory.size(); ++x) {
-                for (size_t y = 0; y < videoMemory.at(x).size(); ++y) {
-                    bool needLightPixel;
-                    {
-                        std::lock_guard<std::mutex> lock(videoMemoryAccess);
-                        needLightPixel = videoMemory.at(x).at(y);
-                    }
-
-                    if(needLightPixel) {
-                        sf::RectangleShape pixel({10, 10});
-                        pixel.setPosition(x * 10, y * 10);
-                        pixel.setFillColor(sf::Color::White);
-                        screen.draw(pixel);
-                    }
-                }
-            }
-            screen.display();
+    static_assert(ListsOperationsInOrder(), "CHIP8_OPERATIONS must follow EOperationType, after UNKNOWN");
 
-            std::this_thread::sleep_for(std::chrono::milliseconds(1000/60));
-        }
-    }
-
-    std::string PrintLikeHex(const uint16_t word) {
+    std::string PrintLikeHex(const uint32_t word) {
         std::stringstream ss;
         ss << std::hex << std::uppercase << word;
         return ss.str();
@@ -94,9 +78,11 @@ namespace {
 
 
 TChip8Machine::TChip8Machine()
-    : Screen(sf::VideoMode(640, 320), "CHIP-8", sf::Style::Close)
+    : Cpu(State)
     {
         ResetState();
+        std::random_device device;
+        SetRandomSeed((uint64_t(device()) << 32) | device());
     }
 
 
@@ -105,7 +91,7 @@ void TChip8Machine::LoadGame(const std::string filePath)
     std::ifstream ifs(filePath, std::ios::binary | std::ios::ate);
     const auto fileSize = ifs.tellg();
 
-    if (fileSize > State.Memory.size() - 0x200) {
+    if (static_cast<size_t>(fileSize) > State.Memory.size() - 0x200) {
         throw std::overflow_error("File is too big for CHIP8 available memory");
     }
 
@@ -113,78 +99,312 @@ void TChip8Machine::LoadGame(const std::string filePath)
     ifs.read(reinterpret_cast<char *>(&State.Memory.at(0x200)), fileSize);
 }
 
-void TChip8Machine::Execute() {
-    sf::Shader::isAvailable();
-
-    std::thread renderingThread([this](){
-        Render(this->Screen, this->State.VideoMemory);
-    });
-
-    std::thread delayTimerThread([this]() {
-        DelayTimer(this->Screen, this->State.DT);
-    });
-
-    std::thread speakerThread([this]() {
-        Speaker(this->Screen, this->State.ST);
-    });
-
-    TCPU CpuTask(State);
-    std::thread executionThread(CpuTask);
-
-    delayTimerThread.detach();
-    speakerThread.detach();
-    renderingThread.detach();
-    executionThread.detach();
-
-
-    static std::map<sf::Keyboard::Key, uint8_t> buttons {
-            {sf::Keyboard::Key::Num1, 1 },
-            {sf::Keyboard::Key::Num2, 2 },
-            {sf::Keyboard::Key::Num3, 3 },
-            {sf::Keyboard::Key::Num4, 0xC },
-            {sf::Keyboard::Key::Q, 4 },
-            {sf::Keyboard::Key::W, 5 },
-            {sf::Keyboard::Key::E, 6 },
-            {sf::Keyboard::Key::R, 0xD },
-            {sf::Keyboard::Key::A, 7 },
-            {sf::Keyboard::Key::S, 8 },
-            {sf::Keyboard::Key::D, 9 },
-            {sf::Keyboard::Key::F, 0xE },
-            {sf::Keyboard::Key::Z, 0xA },
-            {sf::Keyboard::Key::X, 0 },
-            {sf::Keyboard::Key::C, 0xD },
-            {sf::Keyboard::Key::V, 0xF },
-    };
-    while(Screen.isOpen())
-    {
-        sf::Event event;
-        while (Screen.pollEvent(event))
-        {
-            if (event.type == sf::Event::Closed) {
-                Screen.close();
+void TChip8Machine::SetCpuBackend(ECpuBackend backend) {
+    Cpu.SetBackend(backend);
+}
+
+void TChip8Machine::SetFusionMode(EFusionMode mode) {
+    Cpu.SetFusionMode(mode);
+}
+
+std::vector<TChip8Machine::TFusionStat> TChip8Machine::GetFusionStats() const {
+    return Cpu.GetFusionStats();
+}
+
+void TChip8Machine::SetVideoSink(IVideoSink* video) {
+    Cpu.SetVideoSink(video);
+}
+
+void TChip8Machine::SetAudioSink(IAudioSink* audio) {
+    Audio = audio;
+}
+
+void TChip8Machine::SetInputSource(IInputSource* input) {
+    Cpu.SetInputSource(input);
+}
+
+void TChip8Machine::EnableTrace(size_t capacity) {
+#if CHIP8_TRACE_LEVEL == 0
+    (void)capacity;
+    throw std::logic_error("The trace ring is compiled out, rebuild with CHIP8_TRACE_LEVEL=1 or use a trace file");
+#endif
+    Trace.reset(new TTraceBuffer(capacity));
+    Cpu.SetTrace(Trace.get(), TraceFile.get());
+}
+
+void TChip8Machine::EnableTraceFile(const std::string& filePath) {
+    TraceFile.reset(new TTraceFileWriter(filePath));
+    Cpu.SetTrace(Trace.get(), TraceFile.get());
+}
+
+const TTraceBuffer* TChip8Machine::GetTrace() const {
+    return Trace.get();
+}
+
+void TChip8Machine::EnableCounters() {
+    if (!Counters) {
+        Counters.reset(new TExecutionCounters);
+        Cpu.SetCounters(Counters.get());
+    }
+}
+
+const TExecutionCounters* TChip8Machine::GetCounters() const {
+    return Counters.get();
+}
+
+void TChip8Machine::EnableCountersFile(const std::string& filePath) {
+    EnableCounters();
+    CountersPath = filePath;
+}
+
+void TChip8Machine::DumpCounters() const {
+    if (!Counters || CountersPath.empty()) {
+        return;
+    }
+    std::ofstream output(CountersPath);
+    const std::string json = ".json";
+    if (CountersPath.size() >= json.size() && CountersPath.compare(CountersPath.size() - json.size(), json.size(), json) == 0) {
+        Counters->WriteJson(output);
+    } else {
+        Counters->WriteCsv(output);
+    }
+    if (!output) {
+        throw std::runtime_error("Can't write counters to " + CountersPath);
+    }
+}
+
+void TChip8Machine::RequestCountersDump() {
+    CountersDumpRequested = true;
+}
+
+void TChip8Machine::EnableSampling(std::chrono::microseconds interval) {
+    Cpu.SetSampler(nullptr);
+    Sampler.reset(new TSamplingProfiler(interval));
+    Cpu.SetSampler(Sampler.get());
+}
+
+const TSamplingProfiler* TChip8Machine::GetSampler() const {
+    return Sampler.get();
+}
+
+void TChip8Machine::SetEventTracer(TEventTracer* events) {
+    Events = events;
+    Cpu.SetEventTracer(events);
+}
+
+TSnapshot TChip8Machine::SaveState() const {
+    if (State.Stack.size() > TSnapshot::MaxStackDepth || State.PressedKeys.size() > TSnapshot::MaxPendingKeys) {
+        throw std::length_error("Stack or pending keys too deep for a snapshot");
+    }
+
+    TSnapshot snapshot;
+    InitSnapshot(snapshot);
+    snapshot.Cycles = State.Cycles;
+    snapshot.PC = State.PC;
+    snapshot.I = State.I;
+    snapshot.DT = State.DT;
+    snapshot.ST = State.ST;
+    snapshot.V = State.V;
+    snapshot.Random = State.Random.S;
+    snapshot.VideoMemory = State.VideoMemory;
+    snapshot.Memory = State.Memory;
+
+    snapshot.Stack.fill(0);
+    snapshot.StackDepth = State.Stack.size();
+    std::copy(State.Stack.data(), State.Stack.data() + State.Stack.size(), snapshot.Stack.begin());
+
+    snapshot.Keys.fill(0);
+    snapshot.KeysCount = State.PressedKeys.size();
+    for (size_t i = 0; i < State.PressedKeys.size(); ++i) {
+        snapshot.Keys[i] = State.PressedKeys[i];
+    }
+    return snapshot;
+}
+
+void TChip8Machine::LoadState(const TSnapshot& snapshot) {
+    CheckSnapshot(snapshot);
+
+    // Compare in 64-byte chunks and re-decode each run of changed chunks once
+    const size_t chunk = 64;
+    const size_t size = State.Memory.size();
+    for (size_t addr = 0; addr < size;) {
+        const auto differs = [&](size_t at) {
+            return std::memcmp(&State.Memory[at], &snapshot.Memory[at], std::min(chunk, size - at)) != 0;
+        };
+        if (!differs(addr)) {
+            addr += chunk;
+            continue;
+        }
+        size_t end = addr + chunk;
+        while (end < size && differs(end)) {
+            end += chunk;
+        }
+        end = std::min(end, size);
+        Cpu.InvalidateDecodeCache(addr, end - addr);
+        addr = end;
+    }
+
+    State.Memory = snapshot.Memory;
+    State.VideoMemory = snapshot.VideoMemory;
+    State.Cycles = snapshot.Cycles;
+    State.PC = snapshot.PC;
+    State.I = snapshot.I;
+    State.DT = snapshot.DT;
+    State.ST = snapshot.ST;
+    State.V = snapshot.V;
+    State.Random.S = snapshot.Random;
+
+    State.Stack = {};
+    for (size_t i = 0; i < snapshot.StackDepth; ++i) {
+        State.Stack.push(snapshot.Stack[i]);
+    }
+    State.PressedKeys = {};
+    for (size_t i = 0; i < snapshot.KeysCount; ++i) {
+        State.PressedKeys.push(snapshot.Keys[i]);
+    }
+}
+
+void TChip8Machine::SetInstructionsPerTick(uint32_t instructions) {
+    if (instructions == 0) {
+        throw std::invalid_argument("At least one instruction per timer tick is required");
+    }
+    InstructionsPerTick = instructions;
+}
+
+void TChip8Machine::Run(uint64_t instructions) {
+    // Cycles is the clock: the timers tick each time it crosses a multiple of InstructionsPerTick
+    while (instructions > 0) {
+        const uint64_t untilTick = InstructionsPerTick - State.Cycles % InstructionsPerTick;
+        const uint64_t count = std::min(instructions, untilTick);
+        Cpu.Run(count);
+        instructions -= count;
+        if (State.Cycles % InstructionsPerTick == 0) {
+            TickTimers();
+            if (RewindBuffer) {
+                RewindBuffer->Push(SaveState());
             }
-            else if (event.type == sf::Event::KeyPressed) {
-                if (buttons.find(event.key.code) != buttons.end()) {
-                    State.PressedKeys = {};
-                    State.PressedKeys.push(buttons.at(event.key.code));
-                    keyEvent.notify_one();
-                }
+        }
+    }
+}
+
+void TChip8Machine::TickTimers() {
+    if (Events) {
+        Events->Instant("Timer tick");
+    }
+    const bool tone = State.ST > 0;
+    if (State.DT > 0) {
+        --State.DT;
+    }
+    if (State.ST > 0) {
+        --State.ST;
+    }
+    SetTone(tone);
+}
+
+void TChip8Machine::SetTone(bool enabled) {
+    if (Audio && enabled != ToneEnabled) {
+        Audio->SetTone(enabled);
+    }
+    ToneEnabled = enabled;
+}
 
+void TChip8Machine::SetSpeed(double multiplier) {
+    if (!(multiplier >= 0)) {
+        throw std::invalid_argument("Speed multiplier must be non-negative");
+    }
+    Speed = multiplier;
+}
 
+TChip8Machine::EExitReason TChip8Machine::Execute(uint64_t ticks) {
+    Running = true;
+    if (Events) {
+        Events->SetThreadName("cpu");
+    }
+    // Deadlines count from the start, so rounding never accumulates into drift; a speed
+    // change starts counting afresh
+    auto start = std::chrono::steady_clock::now();
+    uint64_t paced = 0;
+    double speed = Speed;
+    EExitReason reason = EExitReason::TickLimit;
+
+    try {
+        for (; Running && ticks > 0; --ticks) {
+            if (const size_t frames = RequestedRewind.exchange(0)) {
+                Rewind(frames);
             }
+            if (CountersDumpRequested.exchange(false)) {
+                DumpCounters();
+            }
+            {
+                TEventScope slice(Events, "Run");
+                Run(InstructionsPerTick);
+            }
+            ++paced;
+
+            const double current = Speed;
+            if (current != speed) {
+                start = std::chrono::steady_clock::now();
+                paced = 0;
+                speed = current;
+            } else if (speed != Unthrottled) {
+                const std::chrono::duration<double> elapsed(paced / (TimerFrequency * speed));
+                TEventScope pace(Events, "Pace");
+                std::this_thread::sleep_until(start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(elapsed));
+                if (Sampler) {
+                    Sampler->Discard();
+                }
+            }
+        }
+        if (ticks > 0) {
+            reason = EExitReason::Stopped;
         }
+    } catch (const TInputClosed&) {
+        reason = EExitReason::InputClosed;
+    } catch (...) {
+        SetTone(false);
+        throw;
+    }
+
+    SetTone(false);
+    return reason;
+}
+
+void TChip8Machine::SetRandomSeed(uint64_t seed) {
+    State.Random.Seed(seed);
+}
+
+void TChip8Machine::EnableRewind(size_t maxBytes) {
+    RewindBuffer.reset(new TRewindBuffer(maxBytes));
+}
+
+bool TChip8Machine::Rewind(size_t frames) {
+    TSnapshot snapshot;
+    if (!RewindBuffer || !RewindBuffer->Rewind(frames, snapshot)) {
+        return false;
     }
+    LoadState(snapshot);
+    return true;
+}
+
+void TChip8Machine::RequestRewind(size_t frames) {
+    RequestedRewind += frames;
+}
+
+void TChip8Machine::Stop() {
+    Running = false;
 }
 
 void TChip8Machine::ResetState() {
-    State.PC = 0;
+    State.PC = 0x200;
+    State.Cycles = 0;
+    State.DT = 0;
+    State.ST = 0;
     State.I = 0;
     State.Memory.fill(0x0);
     State.V.fill(0x0);
-    for (auto& arr: State.VideoMemory) {
-        arr.fill(0x0);
-    }
-
+    State.VideoMemory.fill(0x0);
+    State.Stack = {};
+    State.PressedKeys = {};
 
     const unsigned char sprites[] = {
          0xf0, 0x90, 0x90, 0x90, 0xf0,
@@ -208,90 +428,457 @@ void TChip8Machine::ResetState() {
     std::copy(std::begin(sprites), std::end(sprites), State.Memory.begin() + State.GetSpriteAddr(0));
 }
 
-void TChip8Machine::TCPU::operator()()
+void TChip8Machine::TCPU::Run(uint64_t count)
 {
-    State.PC = 0x200;
+    // Checked once per run, so handlers and backends carry no hooks of their own
+    if (Trace || TraceFile || Counters || Sampler) {
+        RunHooked(count);
+        return;
+    }
+
+    switch (Backend) {
+        case ECpuBackend::Dispatch:
+            for (; count > 0; --count) {
+                Step();
+            }
+            break;
+        case ECpuBackend::Threaded:
+            RunThreaded(count);
+            break;
+        case ECpuBackend::Blocks:
+            RunBlocks(count);
+            break;
+    }
+}
+
+void TChip8Machine::TCPU::Step()
+{
+    const auto instruction = Fetch();
+    ++State.Cycles;
+    (this->*instruction.Handler)(instruction.Opcode);
+}
 
-    typedef void (TChip8Machine::TCPU::*TMemberFunc)(const TOpcode&);
+void TChip8Machine::TCPU::RunHooked(uint64_t count)
+{
+    for (; count > 0; --count) {
+        const uint16_t pc = State.PC;
+        const auto instruction = Fetch();
+        ++State.Cycles;
+
+        const EOperationType type = instruction.Opcode.GetOperationType();
+        if (Counters) {
+            Counters->Count(type, pc);
+        }
+        if (Sampler) {
+            Sampler->Poll(type, State.Stack.data(), State.Stack.size(), State.Memory.data(), State.Memory.size());
+        }
+        CHIP8_TRACE(Trace, TraceFile, State.Cycles, pc, State.Memory, State.V, State.I);
+        (this->*instruction.Handler)(instruction.Opcode);
+    }
+}
+
+void TChip8Machine::TCPU::RunThreaded(uint64_t count)
+{
+    TOpcode opcode;
+
+#if defined(__GNUC__)
+    // Built once, indexed by the operation type each cached decode carries
+    static void* const labels[OperationTypesCount] = {
+        &&unknown,
+#define CHIP8_LABEL(type, handler) &&op_##type,
+        CHIP8_OPERATIONS(CHIP8_LABEL)
+#undef CHIP8_LABEL
+    };
+
+#define CHIP8_DISPATCH() \
+    if (count == 0) { \
+        return; \
+    } \
+    --count; \
+    opcode = Fetch().Opcode; \
+    ++State.Cycles; \
+    goto *labels[static_cast<size_t>(opcode.GetOperationType())]
+
+    CHIP8_DISPATCH();
+
+#define CHIP8_HANDLER(type, handler) op_##type: handler(opcode); CHIP8_DISPATCH();
+    CHIP8_OPERATIONS(CHIP8_HANDLER)
+#undef CHIP8_HANDLER
+#undef CHIP8_DISPATCH
+
+unknown:
+    throw std::logic_error("Not implemented opcode in threaded dispatch");
+#else
+    for (; count > 0; --count) {
+        opcode = Fetch().Opcode;
+        ++State.Cycles;
+        switch (opcode.GetOperationType()) {
+#define CHIP8_CASE(type, handler) case EOperationType::type: handler(opcode); break;
+            CHIP8_OPERATIONS(CHIP8_CASE)
+#undef CHIP8_CASE
+            default:
+                throw std::logic_error("Not implemented opcode in threaded dispatch");
+        }
+    }
+#endif
+}
+
+void TChip8Machine::TCPU::RunBlocks(uint64_t count)
+{
+    // The run of block instructions in progress, and its steps while fusion is on
+    const TDecodedInstruction* instruction = nullptr;
+    const TDecodedInstruction* end = nullptr;
+    const TBlockStep* step = nullptr;
+    TOpcode opcode;
+
+#if defined(__GNUC__)
+    static void* const labels[OperationTypesCount] = {
+        &&unknown,
+#define CHIP8_LABEL(type, handler) &&op_##type,
+        CHIP8_OPERATIONS(CHIP8_LABEL)
+#undef CHIP8_LABEL
+    };
+#endif
 
+next:
+    if (instruction == end) {
+        if (count == 0) {
+            return;
+        }
+
+        const uint16_t pc = State.PC;
+        if (pc % 2 != 0 || pc > AddressMask) {
+            Step();
+            --count;
+            goto next;
+        }
+
+        auto& slot = BlockCache[pc / 2];
+        if (!slot) {
+            slot = TranslateBlock(pc);
+            for (size_t i = pc / 2; i < slot->End / 2; ++i) {
+                BlockCode.set(i);
+            }
+        }
+
+        // Only the last instruction of a block may branch or write memory, so the block
+        // can't be invalidated before it, and nothing of it is touched after it runs.
+        // A tick budget that ends inside the block runs just its head
+        const size_t length = std::min<uint64_t>(count, slot->Instructions.size());
+        count -= length;
+        instruction = slot->Instructions.data();
+        end = instruction + length;
+        step = FusionMode != EFusionMode::Off ? slot->Steps.data() : nullptr;
+    }
+
+    if (step != nullptr) {
+        const TBlockStep current = *step++;
+        if (current.Fusion != NoFusion) {
+            if (instruction + current.Length <= end) {
+                if (FusionMode == EFusionMode::Profile) {
+                    ++FusionHits[current.Fusion];
+                }
+                State.PC += 2;
+                (this->*current.Handler)(instruction);
+                instruction += current.Length;
+                goto next;
+            }
+            // The budget cuts this fused run: finish the block one instruction at a time
+            step = nullptr;
+        }
+    }
+
+    opcode = instruction->Opcode;
+    ++instruction;
+    State.PC += 2;
+    ++State.Cycles;
+
+#if defined(__GNUC__)
+    goto *labels[static_cast<size_t>(opcode.GetOperationType())];
+
+#define CHIP8_HANDLER(type, handler) op_##type: handler(opcode); goto next;
+    CHIP8_OPERATIONS(CHIP8_HANDLER)
+#undef CHIP8_HANDLER
+
+unknown:
+    throw std::logic_error("Not implemented opcode in block dispatch");
+#else
+    switch (opcode.GetOperationType()) {
+#define CHIP8_CASE(type, handler) case EOperationType::type: handler(opcode); break;
+        CHIP8_OPERATIONS(CHIP8_CASE)
+#undef CHIP8_CASE
+        default:
+            throw std::logic_error("Not implemented opcode in block dispatch");
+    }
+    goto next;
+#endif
+}
+
+template <TChip8Machine::TCPU::TMemberFunc... Handlers>
+void TChip8Machine::TCPU::RunFused(const TDecodedInstruction* instructions)
+{
+    const TMemberFunc handlers[] = {Handlers...};
+    TOpcode opcodes[sizeof...(Handlers)];
+    for (size_t i = 0; i < sizeof...(Handlers); ++i) {
+        opcodes[i] = instructions[i].Opcode;
+    }
+
+    // The caller has already advanced PC past the first instruction
+    for (size_t i = 0; i < sizeof...(Handlers); ++i) {
+        if (i > 0) {
+            State.PC += 2;
+        }
+        ++State.Cycles;
+        (this->*handlers[i])(opcodes[i]);
+    }
+}
+
+const std::vector<TChip8Machine::TCPU::TFusion>& TChip8Machine::TCPU::Fusions()
+{
+    // Longest patterns first, so a triple wins over the pair it starts with
+    static const std::vector<TFusion> fusions = {
+        {"LD Vx, LD Vy, DRW", {EOperationType::LD_CONST, EOperationType::LD_CONST, EOperationType::DRAW},
+            &TCPU::RunFused<&TCPU::LoadConst, &TCPU::LoadConst, &TCPU::Draw>},
+        {"LD I, DRW", {EOperationType::LD_ADDR, EOperationType::DRAW},
+            &TCPU::RunFused<&TCPU::LoadAddr, &TCPU::Draw>},
+        {"LD Vx, SE", {EOperationType::LD_CONST, EOperationType::SE_CONST},
+            &TCPU::RunFused<&TCPU::LoadConst, &TCPU::SkipIfEqualToConst>},
+        {"LD Vx, SNE", {EOperationType::LD_CONST, EOperationType::SNE_CONST},
+            &TCPU::RunFused<&TCPU::LoadConst, &TCPU::SkipIfNotEqualToConst>},
+        {"ADD Vx, SE", {EOperationType::ADD_CONST, EOperationType::SE_CONST},
+            &TCPU::RunFused<&TCPU::AddConst, &TCPU::SkipIfEqualToConst>},
+        {"ADD Vx, SNE", {EOperationType::ADD_CONST, EOperationType::SNE_CONST},
+            &TCPU::RunFused<&TCPU::AddConst, &TCPU::SkipIfNotEqualToConst>},
+    };
+    return fusions;
+}
+
+void TChip8Machine::TCPU::FuseBlock(TBlock& block) const
+{
+    const auto& instructions = block.Instructions;
+    const auto& fusions = Fusions();
+
+    block.Steps.clear();
+    for (size_t i = 0; i < instructions.size();) {
+        TBlockStep step { .Handler = nullptr, .Length = 1, .Fusion = NoFusion };
+
+        for (size_t f = 0; FusionMode != EFusionMode::Off && f < fusions.size(); ++f) {
+            const auto& pattern = fusions[f].Pattern;
+            if (i + pattern.size() > instructions.size()) {
+                continue;
+            }
+
+            bool matches = true;
+            for (size_t j = 0; j < pattern.size() && matches; ++j) {
+                matches = instructions[i + j].Opcode.GetOperationType() == pattern[j];
+            }
+
+            if (matches) {
+                step = TBlockStep { .Handler = fusions[f].Handler, .Length = static_cast<uint8_t>(pattern.size()), .Fusion = static_cast<uint8_t>(f) };
+                break;
+            }
+        }
+
+        block.Steps.push_back(step);
+        i += step.Length;
+    }
+}
+
+void TChip8Machine::TCPU::SetFusionMode(EFusionMode mode)
+{
+    FusionMode = mode;
+    FusionHits.assign(Fusions().size(), 0);
+    for (auto& block : BlockCache) {
+        if (block) {
+            FuseBlock(*block);
+        }
+    }
+}
+
+std::vector<TChip8Machine::TFusionStat> TChip8Machine::TCPU::GetFusionStats() const
+{
+    std::vector<TFusionStat> stats;
+    const auto& fusions = Fusions();
+    for (size_t f = 0; f < FusionHits.size(); ++f) {
+        const uint64_t hits = FusionHits[f];
+        stats.push_back(TFusionStat { .Name = fusions[f].Name, .Hits = hits, .DispatchesSaved = hits * (fusions[f].Pattern.size() - 1) });
+    }
+    return stats;
+}
+
+TChip8Machine::TCPU::TBlock TChip8Machine::TCPU::TranslateBlock(uint16_t addr) const
+{
+    static const size_t maxBlockLength = 64;
+
+    TBlock block;
+    block.Start = addr;
+    while (block.Instructions.size() < maxBlockLength && addr + 1u < State.Memory.size()) {
+        const uint16_t word = (State.Memory.at(addr) << 8) | State.Memory.at(addr + 1);
+        block.Instructions.push_back(Decode(word));
+        addr += 2;
+
+        if (EndsBlock(block.Instructions.back().Opcode.GetOperationType())) {
+            break;
+        }
+    }
+    block.End = addr;
+
+    if (block.Instructions.empty()) {
+        std::stringstream ss;
+        ss << "Can't translate block at " << PrintLikeHex(block.Start);
+        throw std::out_of_range(ss.str());
+    }
+
+    FuseBlock(block);
+    return block;
+}
+
+bool TChip8Machine::TCPU::EndsBlock(EOperationType type)
+{
+    switch (type) {
+        case EOperationType::JUMP:
+        case EOperationType::CALL:
+        case EOperationType::RET:
+        case EOperationType::SE_CONST:
+        case EOperationType::SNE_CONST:
+        case EOperationType::SE_VAR:
+        case EOperationType::SNE_VAR:
+        case EOperationType::SE_KEY:
+        case EOperationType::SNE_KEY:
+        case EOperationType::LD_KEY:
+        case EOperationType::STORE_MEM:
+        case EOperationType::STORE_BCD_VAR:
+            return true;
+        default:
+            return false;
+    }
+}
+
+TChip8Machine::TCPU::TDecodedInstruction TChip8Machine::TCPU::Fetch()
+{
+    const uint16_t pc = State.PC;
+    if (pc % 2 != 0) {
+        return Decode(EatWord());
+    }
+
+#if CHIP8_CHECKED_ACCESS
+    if (pc > AddressMask) {
+        ThrowAccessViolation(pc, pc);
+    }
+#endif
+    auto& slot = DecodeCache[(pc & AddressMask) / 2];
+    if (!slot) {
+        slot = Decode(EatWord());
+    } else {
+        State.PC += 2;
+    }
+
+    // Copy out: the handler may overwrite its own code and reset the slot
+    return *slot;
+}
+
+TChip8Machine::TCPU::TDecodedInstruction TChip8Machine::TCPU::Decode(uint16_t opcodeWord)
+{
     static std::map<EOperationType , TMemberFunc> instructions = {
-        {EOperationType::CLS      , &TChip8Machine::TCPU::ClearScreen},
-        {EOperationType::RET      , &TChip8Machine::TCPU::Return},
-        {EOperationType::JUMP     , &TChip8Machine::TCPU::Jump},
-        {EOperationType::CALL     , &TChip8Machine::TCPU::Call},
-        {EOperationType::SE_CONST , &TChip8Machine::TCPU::SkipIfEqualToConst},
-        {EOperationType::SE_VAR , &TChip8Machine::TCPU::SkipIfEqualToVar},
-        {EOperationType::SNE_VAR , &TChip8Machine::TCPU::SkipIfNotEqualToVar},
-        {EOperationType::SE_KEY   , &TChip8Machine::TCPU::SkipIfEqualToKey},
-        {EOperationType::SNE_KEY   , &TChip8Machine::TCPU::SkipIfNotEqualToKey},
-        {EOperationType::SNE_CONST, &TChip8Machine::TCPU::SkipIfNotEqualToConst},
-        {EOperationType::LD_CONST , &TChip8Machine::TCPU::LoadConst},
-        {EOperationType::ADD_CONST, &TChip8Machine::TCPU::AddConst},
-        {EOperationType::LD_VAR   , &TChip8Machine::TCPU::LoadVar},
-        {EOperationType::AND_VAR  , &TChip8Machine::TCPU::AndWithVar},
-        {EOperationType::OR_VAR  , &TChip8Machine::TCPU::OrWithVar},
-        {EOperationType::XOR_VAR  , &TChip8Machine::TCPU::XorWithVar},
-        {EOperationType::ADD_VAR  , &TChip8Machine::TCPU::AddWithVar},
-        {EOperationType::SHR_VAR  , &TChip8Machine::TCPU::ShrWithVar},
-        {EOperationType::SHL_VAR  , &TChip8Machine::TCPU::ShlWithVar},
-        {EOperationType::SUB_VAR  , &TChip8Machine::TCPU::SubWithVar},
-        {EOperationType::SUBN_VAR  , &TChip8Machine::TCPU::SubnWithVar},
-        {EOperationType::LD_ADDR  , &TChip8Machine::TCPU::LoadAddr},
-        {EOperationType::RND      , &TChip8Machine::TCPU::Random},
-        {EOperationType::DRAW     , &TChip8Machine::TCPU::Draw},
-        {EOperationType::LD_KEY   , &TChip8Machine::TCPU::LoadKey},
-        {EOperationType::ADD_ADDR , &TChip8Machine::TCPU::AddWithAddr},
-        {EOperationType::STORE_MEM, &TChip8Machine::TCPU::StoreMemory},
-        {EOperationType::STORE_DT , &TChip8Machine::TCPU::StoreDelayTimer},
-        {EOperationType::STORE_ST , &TChip8Machine::TCPU::StoreSpeakerTimer},
-        {EOperationType::LD_DT    , &TChip8Machine::TCPU::LoadDelayTimer},
-        {EOperationType::LD_ST    , &TChip8Machine::TCPU::LoadSpeakerTimer},
-        {EOperationType::LD_SPRITE, &TChip8Machine::TCPU::LoadSprite},
-        {EOperationType::STORE_BCD_VAR, &TChip8Machine::TCPU::StoreBCDVar},
-        {EOperationType::LD_MEM   , &TChip8Machine::TCPU::LoadMemory},
+#define CHIP8_MAP_ENTRY(type, handler) {EOperationType::type, &TChip8Machine::TCPU::handler},
+        CHIP8_OPERATIONS(CHIP8_MAP_ENTRY)
+#undef CHIP8_MAP_ENTRY
     };
 
+    const auto& opcode = TOpcodeParser::Parse(opcodeWord);
+    auto it = instructions.find(opcode.GetOperationType());
+    if (it == instructions.end()) {
+        std::stringstream ss;
+        ss << "Not implemented opcode: " << PrintLikeHex(opcodeWord);
+        throw std::logic_error(ss.str());
+    }
+
+    return TDecodedInstruction { .Handler = it->second, .Opcode = opcode };
+}
+
+void TChip8Machine::TCPU::InvalidateDecodeCache(uint16_t addr, size_t count)
+{
+    if (count == 0) {
+        return;
+    }
+
+    const size_t first = addr / 2;
+    const size_t last = std::min<size_t>((addr + count - 1) / 2, DecodeCache.size() - 1);
+    bool hitsBlock = false;
+    for (size_t slot = first; slot <= last; ++slot) {
+        DecodeCache[slot] = boost::none;
+        hitsBlock = hitsBlock || BlockCode.test(slot);
+    }
 
-    while (true) {
-        const auto opcodeWord = EatWord();
+    if (!hitsBlock) {
+        return;
+    }
 
-        const auto& opcode = TOpcodeParser::Parse(opcodeWord);
-        auto it = instructions.find(opcode.GetOperationType());
-        if (it != instructions.end()) {
-            auto instr = it->second;
-            (this->*instr)(opcode);
-        } else {
-            std::stringstream ss;
-            ss << "Not implemented opcode: " << PrintLikeHex(opcodeWord);
-            throw std::logic_error(ss.str());
+    // Drop every block overlapping the written range and recompute the coverage map
+    BlockCode.reset();
+    for (auto& block : BlockCache) {
+        if (!block) {
+            continue;
+        }
+        if (block->Start / 2 <= last && first < block->End / 2) {
+            block = boost::none;
+            continue;
+        }
+        for (size_t i = block->Start / 2; i < block->End / 2; ++i) {
+            BlockCode.set(i);
         }
     }
 }
 
+void TChip8Machine::TCPU::ThrowAccessViolation(uint32_t addr, uint16_t pc) const
+{
+    std::stringstream ss;
+    ss << "Memory access at " << PrintLikeHex(addr) << " out of range at " << PrintLikeHex(pc);
+    throw std::out_of_range(ss.str());
+}
+
+void TChip8Machine::TCPU::InvalidateWritten(uint32_t addr, size_t count)
+{
+    // A write running past the top of memory wraps around to its bottom
+    addr &= AddressMask;
+    const size_t head = std::min<size_t>(count, AddressMask + 1 - addr);
+    InvalidateDecodeCache(addr, head);
+    InvalidateDecodeCache(0, count - head);
+}
+
 uint16_t TChip8Machine::TCPU::EatWord()
 {
-    uint16_t word = (State.Memory.at(State.PC) << 8) | State.Memory.at(State.PC + 1);
+    uint16_t word = (MemoryAt(State.PC, State.PC) << 8) | MemoryAt(State.PC + 1, State.PC);
     State.PC += 2;
     return word;
 }
 
+void TChip8Machine::TCPU::PublishFrame()
+{
+    if (Video) {
+        Video->PresentFrame(State.VideoMemory);
+    }
+}
+
+void TChip8Machine::TCPU::PollInput()
+{
+    if (Input) {
+        Input->Poll(State.Cycles, State.PressedKeys);
+    }
+}
+
 void TChip8Machine::TCPU::LoadAddr(const TOpcode& opcode) {
     uint16_t loadWhat = opcode.GetArgs<TAddress>().Value;
-    std::cout << "LD I, " << PrintLikeHex(loadWhat) << '\n';
     State.I = loadWhat;
 }
 
 void TChip8Machine::TCPU::Random(const TOpcode& opcode) {
-    std::random_device r;
-    std::default_random_engine e1(r());
-    std::uniform_int_distribution<uint8_t> uniform_dist(0, 255);
-    uint8_t mean = uniform_dist(e1);
+    const uint8_t value = State.Random.Next() >> 24;
 
     const auto& args = opcode.GetArgs<TVarWithConst>();
     uint16_t andWith = args.Const;
 
-    std::cout << "RND V" << PrintLikeHex(args.X) << ", " << PrintLikeHex(andWith) << '\n';
-    State.V.at(args.X) = static_cast<uint8_t>(mean & andWith);
+    Var(args.X) = static_cast<uint8_t>(value & andWith);
 }
 
 void TChip8Machine::TCPU::SkipIfEqualToConst(const TOpcode& opcode) {
@@ -299,9 +886,7 @@ void TChip8Machine::TCPU::SkipIfEqualToConst(const TOpcode& opcode) {
 
     uint8_t compareWith = args.Const;
 
-    std::cout << "SE V" << PrintLikeHex(args.X) << ", " << PrintLikeHex(compareWith) << '\n';
-
-    if (State.V.at(args.X) == compareWith) {
+    if (Var(args.X) == compareWith) {
         State.PC += 2;
     }
 }
@@ -309,9 +894,7 @@ void TChip8Machine::TCPU::SkipIfEqualToConst(const TOpcode& opcode) {
 void TChip8Machine::TCPU::SkipIfEqualToVar(const TOpcode& opcode) {
     const auto& args = opcode.GetArgs<TTwoVars>();
 
-    std::cout << "SE V" << PrintLikeHex(args.X) << ", V" << PrintLikeHex(args.Y) << '\n';
-
-    if (State.V.at(args.X) == State.V.at(args.Y)) {
+    if (Var(args.X) == Var(args.Y)) {
         State.PC += 2;
     }
 }
@@ -319,9 +902,7 @@ void TChip8Machine::TCPU::SkipIfEqualToVar(const TOpcode& opcode) {
 void TChip8Machine::TCPU::SkipIfNotEqualToVar(const TOpcode& opcode) {
     const auto& args = opcode.GetArgs<TTwoVars>();
 
-    std::cout << "SNE V" << PrintLikeHex(args.X) << ", V" << PrintLikeHex(args.Y) << '\n';
-
-    if (State.V.at(args.X) == State.V.at(args.Y)) {
+    if (Var(args.X) == Var(args.Y)) {
         State.PC += 2;
     }
 }
@@ -331,40 +912,31 @@ void TChip8Machine::TCPU::SkipIfNotEqualToConst(const TOpcode& opcode) {
 
     uint8_t compareWith = args.Const;
 
-    std::cout << "SNE V" << PrintLikeHex(args.X) << ", " << PrintLikeHex(compareWith) << '\n';
-
-    if (State.V.at(args.X) != compareWith) {
+    if (Var(args.X) != compareWith) {
         State.PC += 2;
     }
 }
 
 void TChip8Machine::TCPU::Draw(const TOpcode& opcode) {
+    TEventScope drawScope(Events, "Draw");
     const auto& args = opcode.GetArgs<TTwoVarsWithConst>();
     uint8_t memSize = args.Const;
 
-    std::cout << "DRW V" << PrintLikeHex(args.X) << ", V"
-                         << PrintLikeHex(args.Y) << '\n';
+    const size_t x = Var(args.X) % ScreenWidth;
+    const size_t y = Var(args.Y);
 
-    State.V.at(0xF) = 0;
+    bool collision = false;
     for (size_t i = 0; i < memSize; ++i) {
-        uint8_t memoryByte = State.Memory.at(State.I + i);
-        for (size_t j = 0; j < 8; ++j) {
-
-            uint8_t value = (memoryByte >> (7 - j)) & 0x1;
-            size_t x = (State.V.at(args.X) + j) % State.VideoMemory.size();
-            size_t y = (State.V.at(args.Y) + i) % State.VideoMemory.at(x).size();
-
-            std::lock_guard<std::mutex> lock(videoMemoryAccess);
-            if (static_cast<bool>(value) && State.VideoMemory.at(x).at(y)) {
-                State.V.at(0xF) = 1;
-                std::cout << "BINGO!!" << std::endl;
-            }
+        // Place the sprite byte at the left edge and rotate it to x, wrapping around the screen
+        const uint64_t spriteRow = static_cast<uint64_t>(MemoryAt(State.I + i, State.PC - 2)) << (ScreenWidth - 8);
+        const uint64_t bits = x == 0 ? spriteRow : (spriteRow >> x) | (spriteRow << (ScreenWidth - x));
 
-            State.VideoMemory.at(x).at(y) = value ^ State.VideoMemory.at(x).at(y);
-        }
+        auto& row = State.VideoMemory[(y + i) % ScreenHeight];
+        collision = collision || (row & bits) != 0;
+        row ^= bits;
     }
-
-    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    Var(0xF) = collision ? 1 : 0;
+    PublishFrame();
 }
 
 void TChip8Machine::TCPU::AddConst(const TOpcode& opcode) {
@@ -373,16 +945,12 @@ void TChip8Machine::TCPU::AddConst(const TOpcode& opcode) {
     uint8_t x = args.X;
     uint8_t addWith = args.Const;;
 
-    std::cout << "ADD V" << PrintLikeHex(x) << ", "
-                         << PrintLikeHex(addWith) << "\n";
-
-    uint16_t sum = State.V.at(x) + addWith;
-    State.V.at(x) = sum & 0x00FF;
+    uint16_t sum = Var(x) + addWith;
+    Var(x) = sum & 0x00FF;
 }
 
 void TChip8Machine::TCPU::Jump(const TOpcode& opcode) {
    uint16_t jumpTo = opcode.GetArgs<TAddress>().Value;
-   std::cout << "JP " << PrintLikeHex(jumpTo) << '\n';
 
     State.PC = jumpTo;
 }
@@ -393,165 +961,142 @@ void TChip8Machine::TCPU::LoadConst(const TOpcode& opcode) {
     uint8_t x = args.X;
     uint8_t loadWhat = args.Const;
 
-    std::cout << "LD V" << PrintLikeHex(x) << ", "
-                        << PrintLikeHex(loadWhat) << '\n';
-
-    State.V.at(x) = loadWhat;
+    Var(x) = loadWhat;
 }
 
 void TChip8Machine::TCPU::Call(const TOpcode& opcode) {
     uint16_t callTo = opcode.GetArgs<TAddress>().Value;
+    if (State.Stack.full()) {
+        throw std::overflow_error("Call stack overflow at " + PrintLikeHex(State.PC - 2));
+    }
     State.Stack.push(State.PC);
     State.PC = callTo;
-
-    std::cout << "CALL " << PrintLikeHex(callTo) << '\n';
 }
 
 void TChip8Machine::TCPU::Return(const TOpcode& opcode) {
+    if (State.Stack.empty()) {
+        throw std::underflow_error("Return with an empty call stack at " + PrintLikeHex(State.PC - 2));
+    }
     State.PC = State.Stack.top();
     State.Stack.pop();
-    std::cout << "RET " << PrintLikeHex(State.PC) << '\n';
 }
 
 void TChip8Machine::TCPU::LoadVar(const TOpcode& opcode) {
     const auto& args = opcode.GetArgs<TTwoVars>();
 
-    State.V.at(args.X) = State.V.at(args.Y);
-    std::cout << "SET V" << PrintLikeHex(args.X) << " V" << PrintLikeHex(args.Y) << '\n';
+    Var(args.X) = Var(args.Y);
 }
 
 void TChip8Machine::TCPU::AndWithVar(const TOpcode& opcode) {
     const auto& args = opcode.GetArgs<TTwoVars>();
 
-    State.V.at(args.X) = State.V.at(args.X) & State.V.at(args.Y);
-    std::cout << "AND V" << PrintLikeHex(args.X) << " V" << PrintLikeHex(args.Y) << '\n';
+    Var(args.X) = Var(args.X) & Var(args.Y);
 }
 
 void TChip8Machine::TCPU::XorWithVar(const TOpcode& opcode) {
     const auto& args = opcode.GetArgs<TTwoVars>();
 
-    State.V.at(args.X) = State.V.at(args.X) ^ State.V.at(args.Y);
-    std::cout << "XOR V" << PrintLikeHex(args.X) << " V" << PrintLikeHex(args.Y) << '\n';
+    Var(args.X) = Var(args.X) ^ Var(args.Y);
 }
 
-
 void TChip8Machine::TCPU::AddWithVar(const TOpcode& opcode) {
     const auto& args = opcode.GetArgs<TTwoVars>();
-    uint16_t sum = State.V.at(args.X) + State.V.at(args.Y);
+    uint16_t sum = Var(args.X) + Var(args.Y);
 
-    State.V.at(args.X) = static_cast<uint8_t>(sum & 0x00FF);
-    State.V.at(0xF) = static_cast<uint8_t>(sum >= std::numeric_limits<uint8_t>::max());
-    std::cout << "ADD V" << PrintLikeHex(args.X) << " V" << PrintLikeHex(args.Y) << '\n';
+    Var(args.X) = static_cast<uint8_t>(sum & 0x00FF);
+    Var(0xF) = static_cast<uint8_t>(sum >= std::numeric_limits<uint8_t>::max());
 }
 
 void TChip8Machine::TCPU::SubWithVar(const TOpcode& opcode) {
     const auto& args = opcode.GetArgs<TTwoVars>();
 
-    State.V.at(0xF) = static_cast<uint16_t>(State.V.at(args.X) >= State.V.at(args.Y));
-    State.V.at(args.X) = State.V.at(args.X) - State.V.at(args.Y);
-
-    std::cout << "SUB V" << PrintLikeHex(args.X) << " V" << PrintLikeHex(args.Y) << '\n';
+    Var(0xF) = static_cast<uint16_t>(Var(args.X) >= Var(args.Y));
+    Var(args.X) = Var(args.X) - Var(args.Y);
 }
 
 void TChip8Machine::TCPU::SubnWithVar(const TOpcode& opcode) {
     const auto& args = opcode.GetArgs<TTwoVars>();
 
-    State.V.at(0xF) = static_cast<uint16_t>(State.V.at(args.Y) >= State.V.at(args.X));
-    State.V.at(args.X) = State.V.at(args.Y) - State.V.at(args.X);
-
-    std::cout << "SUBN V" << PrintLikeHex(args.X) << " V" << PrintLikeHex(args.Y) << '\n';
+    Var(0xF) = static_cast<uint16_t>(Var(args.Y) >= Var(args.X));
+    Var(args.X) = Var(args.Y) - Var(args.X);
 }
 
 void TChip8Machine::TCPU::AddWithAddr(const TOpcode& opcode) {
     uint8_t x = opcode.GetArgs<TVar>().X;
-    State.I = State.I + State.V.at(x);
-    std::cout << "ADD I, V" << PrintLikeHex(x) << '\n';
+    State.I = State.I + Var(x);
 }
 
 void TChip8Machine::TCPU::LoadKey(const TOpcode& opcode) {
     uint8_t x = opcode.GetArgs<TVar>().X;
-    std::cout << "KEY V" << PrintLikeHex(x) << std::endl;
+    PollInput();
     if (State.PressedKeys.empty()) {
-        std::unique_lock<std::mutex> lock(executionLock);
-        keyEvent.wait(lock);
+        // Wait by executing this instruction again, so the clock and timers keep running
+        State.PC -= 2;
+        if (!Input || !Input->IsOpen()) {
+            throw TInputClosed();
+        }
+        return;
     }
 
     uint8_t key = State.PressedKeys.front();
     State.PressedKeys.pop();
-    State.V.at(x) = key;
+    Var(x) = key;
 }
 
 void TChip8Machine::TCPU::LoadMemory(const TOpcode& opcode) {
     uint8_t x = opcode.GetArgs<TVar>().X;
-    std::cout << "STORE [I] V0..V" << PrintLikeHex(x) << '\n';
     for (size_t i = 0; i <= x; ++i) {
-        State.V.at(i) = State.Memory.at(State.I + i);
+        Var(i) = MemoryAt(State.I + i, State.PC - 2);
     }
 }
 
 void TChip8Machine::TCPU::StoreMemory(const TOpcode& opcode) {
     uint8_t x = opcode.GetArgs<TVar>().X;
-    std::cout << "LD [I] V0..V" << PrintLikeHex(x) << '\n';
     for (size_t i = 0; i <= x; ++i) {
-        State.Memory.at(State.I + i) = State.V.at(i);
+        MemoryAt(State.I + i, State.PC - 2) = Var(i);
     }
+    InvalidateWritten(State.I, x + 1);
 }
 
 void TChip8Machine::TCPU::ClearScreen(const TOpcode& opcode) {
-    for(auto& arr: State.VideoMemory) {
-        arr.fill(0x0);
-    }
-
-    std::cout << "CLS\n";
+    State.VideoMemory.fill(0x0);
+    PublishFrame();
 }
 
 void TChip8Machine::TCPU::StoreBCDVar(const TOpcode& opcode) {
     uint8_t x = opcode.GetArgs<TVar>().X;
-    uint8_t var = State.V.at(x);
-    State.Memory.at(State.I) = var / 100;
-    State.Memory.at(State.I + 1) = (var / 10) % 10;
-    State.Memory.at(State.I + 2) = var % 10;
-    std::cout << "LD B, V" << PrintLikeHex(x) << '\n';
+    uint8_t var = Var(x);
+    MemoryAt(State.I, State.PC - 2) = var / 100;
+    MemoryAt(State.I + 1, State.PC - 2) = (var / 10) % 10;
+    MemoryAt(State.I + 2, State.PC - 2) = var % 10;
+    InvalidateWritten(State.I, 3);
 }
 
 void TChip8Machine::TCPU::StoreDelayTimer(const TOpcode& opcode) {
     auto x = opcode.GetArgs<TVar>().X;
-    {
-        std::lock_guard<std::mutex> lock(delayTimerAccess);
-        State.DT = State.V.at(x);
-    }
-
-    std::cout << "LD DT, V" << PrintLikeHex(x) << '\n';
+    State.DT = Var(x);
 }
 
 void TChip8Machine::TCPU::LoadDelayTimer(const TOpcode& opcode) {
     auto x = opcode.GetArgs<TVar>().X;
-    {
-        std::lock_guard<std::mutex> lock(delayTimerAccess);
-        State.V.at(x) = State.DT;
-    }
-    std::cout << "LD V" << PrintLikeHex(x) << ", DT\n";
+    Var(x) = State.DT;
 }
 
 void TChip8Machine::TCPU::LoadSpeakerTimer(const TOpcode& opcode) {
     auto x = opcode.GetArgs<TVar>().X;
-    {
-        std::lock_guard<std::mutex> lock(speakerTimerAccess);
-        State.V.at(x) = State.ST;
-    }
-    std::cout << "LD V" << PrintLikeHex(x) << ", ST\n";
+    Var(x) = State.ST;
 }
 
 void TChip8Machine::TCPU::SkipIfEqualToKey(const TOpcode& opcode) {
     uint8_t x = opcode.GetArgs<TVar>().X;
-    std::cout << "SKP V" << PrintLikeHex(x) << std::endl;
 
+    PollInput();
     if (State.PressedKeys.empty()) {
         return;
     }
     uint8_t key = State.PressedKeys.front();
 
-    if(State.V.at(x) == key) {
+    if(Var(x) == key) {
         State.PressedKeys.pop();
         State.PC += 2;
     }
@@ -559,22 +1104,20 @@ void TChip8Machine::TCPU::SkipIfEqualToKey(const TOpcode& opcode) {
 
 void TChip8Machine::TCPU::LoadSprite(const TOpcode& opcode) {
     const uint8_t x = opcode.GetArgs<TVar>().X;
-    uint8_t num = State.V.at(x);
+    uint8_t num = Var(x);
     State.I = State.GetSpriteAddr(num);
-
-    std::cout << "LD F, V" << PrintLikeHex(x) << '\n';
 }
 
 void TChip8Machine::TCPU::SkipIfNotEqualToKey(const TOpcode& opcode) {
     uint8_t x = opcode.GetArgs<TVar>().X;
-    std::cout << "SKNP V" << PrintLikeHex(x) << std::endl;
 
+    PollInput();
     if (State.PressedKeys.empty()) {
         State.PC += 2;
         return;
     }
     uint8_t key = State.PressedKeys.front();
-    if(State.V.at(x) != key) {
+    if(Var(x) != key) {
         State.PC += 2;
     }
     else {
@@ -584,33 +1127,25 @@ void TChip8Machine::TCPU::SkipIfNotEqualToKey(const TOpcode& opcode) {
 
 void TChip8Machine::TCPU::StoreSpeakerTimer(const TOpcode& opcode) {
     auto x = opcode.GetArgs<TVar>().X;
-    {
-        std::lock_guard<std::mutex> lock(speakerTimerAccess);
-        State.ST = State.V.at(x);
-    }
-
-    std::cout << "LD ST, V" << PrintLikeHex(x) << '\n';
+    State.ST = Var(x);
 }
 
 void TChip8Machine::TCPU::ShrWithVar(const TOpcode& opcode) {
     const auto& args = opcode.GetArgs<TTwoVars>();
-    const uint16_t operand = State.V.at(args.Y);
-    State.V.at(args.X) = operand >> 1;
-    State.V.at(0xF) = operand & 0x1;
-    std::cout << "SHR V" << PrintLikeHex(args.X) << " V" << PrintLikeHex(args.Y) << '\n';
+    const uint16_t operand = Var(args.Y);
+    Var(args.X) = operand >> 1;
+    Var(0xF) = operand & 0x1;
 }
 
 void TChip8Machine::TCPU::ShlWithVar(const TOpcode& opcode) {
     const auto& args = opcode.GetArgs<TTwoVars>();
-    const uint16_t operand = State.V.at(args.Y);
-    State.V.at(args.X) = operand << 1;
-    State.V.at(0xF) = operand & 0x8000;
-    std::cout << "SHL V" << PrintLikeHex(args.X) << " V" << PrintLikeHex(args.Y) << '\n';
+    const uint16_t operand = Var(args.Y);
+    Var(args.X) = operand << 1;
+    Var(0xF) = operand & 0x8000;
 }
 
 void TChip8Machine::TCPU::OrWithVar(const TOpcode& opcode) {
     const auto& args = opcode.GetArgs<TTwoVars>();
 
-    State.V.at(args.X) = State.V.at(args.X) | State.V.at(args.Y);
-    std::cout << "OR V" << PrintLikeHex(args.X) << " V" << PrintLikeHex(args.Y) << '\n';
+    Var(args.X) = Var(args.X) | Var(args.Y);
 }
@@ -2,52 +2,240 @@
 
 #include <string>
 #include <array>
-#include <SFML/Graphics/RenderWindow.hpp>
-#include <stack>
-#include <queue>
+#include <atomic>
+#include <bitset>
+#include <limits>
+#include <memory>
+#include <vector>
+#include <type_traits>
+#include <boost/optional.hpp>
+#include <io/audio.h>
+#include <io/input.h>
+#include <io/video.h>
+#include <opcode/types.h>
+#include <state/rewind.h>
+#include <state/snapshot.h>
+#include <trace/counters.h>
+#include <trace/events.h>
+#include <trace/sampler.h>
+#include <trace/trace.h>
+#include <utils/fixed_containers.h>
+#include <utils/random.h>
 
-class TOpcode;
+// Return addresses the call stack holds; a CALL beyond that throws std::overflow_error.
+// Save states only fit up to TSnapshot::MaxStackDepth
+#ifndef CHIP8_STACK_DEPTH
+#define CHIP8_STACK_DEPTH 16
+#endif
+
+// 1: handlers check memory addresses and throw std::out_of_range naming the faulting PC.
+// 0: addresses wrap to 12 bits like the real address bus, which can't leave the 4K image,
+//    so hot handlers access memory and registers unchecked
+#ifndef CHIP8_CHECKED_ACCESS
+#define CHIP8_CHECKED_ACCESS 1
+#endif
 
 
 class TChip8Machine {
+    template <size_t Lanes>
+    friend class TLockstepEngine;
+
 public:
-    using TVideoMemory = std::array<std::array<bool, 32>, 64>;
+    using TVideoMemory = ::TVideoMemory;
+
+    enum class ECpuBackend {
+        Dispatch,   // handler lookup and pointer-to-member call per instruction
+        Threaded,   // direct-threaded dispatch (labels-as-values, switch elsewhere)
+        Blocks,     // cached straight-line blocks, run without per-instruction fetch
+    };
+
+    // Superinstruction fusion, applied while translating blocks for ECpuBackend::Blocks
+    enum class EFusionMode {
+        Off,
+        On,
+        Profile,    // fuse and count how often each fused handler runs
+    };
+
+    // Why Execute returned
+    enum class EExitReason {
+        Stopped,        // Stop() was called
+        TickLimit,      // the requested number of ticks ran
+        InputClosed,    // the program waits for a key that will never come
+    };
+
+    struct TFusionStat {
+        std::string Name;
+        uint64_t Hits;
+        uint64_t DispatchesSaved;
+    };
 
 private:
     struct TState {
-        std::array<uint8_t, 0xFFF> Memory;
+        std::array<uint8_t, 0x1000> Memory;     // the whole 12-bit address space
         TVideoMemory VideoMemory;
 
         uint16_t PC;
+        uint64_t Cycles;
         std::array<uint8_t, 16> V;
         uint16_t I;
 
-        volatile uint8_t DT;
-        volatile uint8_t ST;
+        uint8_t DT;
+        uint8_t ST;
 
-        std::stack<uint16_t> Stack;
-        std::queue<uint8_t> PressedKeys;
+        TFixedStack<uint16_t, CHIP8_STACK_DEPTH> Stack;     // return addresses, SP counts them
+        TPendingKeys PressedKeys;
+
+        TXoshiro128 Random;
 
         uint16_t GetSpriteAddr(size_t num) {
+            const int spritesEnd = 0xFFF;
             const int spritesCount = 16;
             const int spriteSize = 5;
-            return Memory.size() - spriteSize * (spritesCount - num);
+            return spritesEnd - spriteSize * (spritesCount - num);
         }
     };
 
+    static_assert(std::is_trivially_copyable<TState>::value, "Machine state is copied as plain bytes");
+
 
     class TCPU {
     public:
-        TCPU(TState& state)
+        TCPU(TState& state, ECpuBackend backend = ECpuBackend::Dispatch)
             : State(state)
+            , Backend(backend)
         {};
 
-        void operator() ();
+        void Run(uint64_t count);
+        void Step();
+
+        void SetBackend(ECpuBackend backend) {
+            Backend = backend;
+        }
+
+        // Drops decoded instructions and blocks covering memory that was written
+        void InvalidateDecodeCache(uint16_t addr, size_t count);
+
+        void SetFusionMode(EFusionMode mode);
+        std::vector<TFusionStat> GetFusionStats() const;
+
+        void SetVideoSink(IVideoSink* video) {
+            Video = video;
+        }
+
+        // Without an input source key checks see no keys and LD Vx, K throws TInputClosed
+        void SetInputSource(IInputSource* input) {
+            Input = input;
+        }
+
+        void SetTrace(TTraceBuffer* trace, TTraceFileWriter* traceFile = nullptr) {
+            Trace = trace;
+            TraceFile = traceFile;
+        }
+
+        void SetCounters(TExecutionCounters* counters) {
+            Counters = counters;
+        }
+
+        void SetSampler(TSamplingProfiler* sampler) {
+            Sampler = sampler;
+        }
+
+        void SetEventTracer(TEventTracer* events) {
+            Events = events;
+        }
 
     private:
+        typedef void (TCPU::*TMemberFunc)(const TOpcode&);
+
+        struct TDecodedInstruction {
+            TMemberFunc Handler;
+            TOpcode Opcode;
+        };
+
+        typedef void (TCPU::*TStepFunc)(const TDecodedInstruction*);
+
+        // One dispatch inside a block: a single instruction, dispatched by its operation type,
+        // or a fused run of Length instructions through Handler
+        struct TBlockStep {
+            TStepFunc Handler;
+            uint8_t Length;
+            uint8_t Fusion;
+        };
+
+        struct TFusion {
+            const char* Name;
+            std::vector<EOperationType> Pattern;
+            TStepFunc Handler;
+        };
+
+        static const uint8_t NoFusion = 0xFF;
+
+        // Straight-line run of instructions ending at the first branch, skip, key wait or memory write
+        struct TBlock {
+            uint16_t Start;
+            uint16_t End;
+            std::vector<TDecodedInstruction> Instructions;
+            std::vector<TBlockStep> Steps;
+        };
+
+        // One slot per aligned word of the 4K address space, filled on first execution
+        static const size_t DecodeCacheSize = 0x1000 / 2;
+
         TState& State;
+        ECpuBackend Backend;
+        std::array<boost::optional<TDecodedInstruction>, DecodeCacheSize> DecodeCache;
+        std::array<boost::optional<TBlock>, DecodeCacheSize> BlockCache;
+        std::bitset<DecodeCacheSize> BlockCode;
+        EFusionMode FusionMode = EFusionMode::Off;
+        std::vector<uint64_t> FusionHits;
+        IVideoSink* Video = nullptr;
+        IInputSource* Input = nullptr;
+        TTraceBuffer* Trace = nullptr;
+        static const uint16_t AddressMask = 0xFFF;
+
+        TTraceFileWriter* TraceFile = nullptr;
+        TExecutionCounters* Counters = nullptr;
+        TSamplingProfiler* Sampler = nullptr;
+        TEventTracer* Events = nullptr;
     private:
+        // `pc` is the instruction reported if the address is out of range
+        uint8_t& MemoryAt(uint32_t addr, uint16_t pc) {
+#if CHIP8_CHECKED_ACCESS
+            if (addr > AddressMask) {
+                ThrowAccessViolation(addr, pc);
+            }
+#endif
+            return State.Memory[addr & AddressMask];
+        }
+
+        // Register fields are four bits wide, so they can't index past V
+        uint8_t& Var(uint8_t x) {
+#if CHIP8_CHECKED_ACCESS
+            return State.V.at(x);
+#else
+            return State.V[x];
+#endif
+        }
+
+        [[noreturn]] void ThrowAccessViolation(uint32_t addr, uint16_t pc) const;
+        void InvalidateWritten(uint32_t addr, size_t count);
         uint16_t EatWord();
+        void PublishFrame();
+        void PollInput();
+        // Runs one instruction at a time on any backend, with the trace, counters and
+        // sampler wrapped around each handler
+        void RunHooked(uint64_t count);
+        void RunThreaded(uint64_t count);
+        void RunBlocks(uint64_t count);
+        TBlock TranslateBlock(uint16_t addr) const;
+        static bool EndsBlock(EOperationType type);
+        void FuseBlock(TBlock& block) const;
+        static const std::vector<TFusion>& Fusions();
+
+        template <TMemberFunc... Handlers>
+        void RunFused(const TDecodedInstruction* instructions);
+        TDecodedInstruction Fetch();
+        static TDecodedInstruction Decode(uint16_t word);
 
         void ClearScreen(const TOpcode&);
         void Draw(const TOpcode& opcode);
@@ -93,13 +281,107 @@ public:
     TChip8Machine();
 
     void LoadGame(const std::string filePath);
-    void Execute();
+    void SetCpuBackend(ECpuBackend backend);
+    void SetFusionMode(EFusionMode mode);
+    std::vector<TFusionStat> GetFusionStats() const;
+
+    // Devices are optional and not owned; a machine without any runs headless
+    void SetVideoSink(IVideoSink* video);
+    void SetAudioSink(IAudioSink* audio);
+    void SetInputSource(IInputSource* input);
+
+    // Throws std::logic_error when the trace ring is compiled out (CHIP8_TRACE_LEVEL=0)
+    void EnableTrace(size_t capacity);
+    const TTraceBuffer* GetTrace() const;
+    // Records at every trace level
+    void EnableTraceFile(const std::string& filePath);
+
+    // Counts executed instructions per operation type and per address from now on
+    void EnableCounters();
+    const TExecutionCounters* GetCounters() const;
+
+    // DumpCounters writes the counters to `filePath`, as JSON if it ends in ".json", CSV otherwise
+    void EnableCountersFile(const std::string& filePath);
+    void DumpCounters() const;
+
+    // Async-signal-safe: Execute dumps the counters before its next tick
+    void RequestCountersDump();
+
+    // Samples the emulated call stack and running operation every `interval` of host time
+    void EnableSampling(std::chrono::microseconds interval = TSamplingProfiler::DefaultInterval);
+    const TSamplingProfiler* GetSampler() const;
+
+    // Not owned; Execute records its thread's run slices, pacing sleeps, timer ticks and draws
+    void SetEventTracer(TEventTracer* events);
+
+    // The timers tick at TimerFrequency of emulated time, once every `instructions` instructions
+    void SetInstructionsPerTick(uint32_t instructions);
+
+    // Runs exactly `instructions` instructions on the calling thread as fast as possible
+    void Run(uint64_t instructions);
+
+    // Wall-clock pace of Execute relative to real time; Unthrottled runs as fast as possible.
+    // Safe to change from another thread while Execute runs
+    void SetSpeed(double multiplier);
+
+    // Runs up to `ticks` timer ticks on the calling thread, paced by the speed multiplier,
+    // until Stop() or until the program waits for a key that the input source can no longer deliver
+    EExitReason Execute(uint64_t ticks = std::numeric_limits<uint64_t>::max());
+    void Stop();
+
+    // Throws std::length_error if the stack or the pending keys don't fit a snapshot
+    TSnapshot SaveState() const;
+
+    // Re-decodes only the code that differs from the current memory
+    void LoadState(const TSnapshot& snapshot);
+
+    // RND draws from a per-machine generator; a new machine seeds it from the host.
+    // Equal seeds, programs and inputs give equal runs
+    void SetRandomSeed(uint64_t seed);
+
+    // Keeps a snapshot of every timer tick, as much history as fits in `maxBytes`
+    void EnableRewind(size_t maxBytes);
+
+    // Goes back `frames` timer ticks, or as far as the history reaches. Returns false
+    // if rewind is off or nothing has been recorded yet
+    bool Rewind(size_t frames);
+
+    // Rewinds from another thread: Execute goes back `frames` ticks before its next tick
+    void RequestRewind(size_t frames);
+
+    uint64_t GetCycles() const {
+        return State.Cycles;
+    }
+
+    const TVideoMemory& GetVideoMemory() const {
+        return State.VideoMemory;
+    }
+
+    static const int TimerFrequency = 60;
+    static const uint32_t DefaultInstructionsPerTick = 10;
+    static constexpr double Unthrottled = 0;
 
 private:
     TState State;
-    sf::RenderWindow Screen;
+    TCPU Cpu;
+    IAudioSink* Audio = nullptr;
+    uint32_t InstructionsPerTick = DefaultInstructionsPerTick;
+    bool ToneEnabled = false;
+    std::atomic<double> Speed {1};
+    std::atomic<bool> Running {false};
+    std::atomic<size_t> RequestedRewind {0};
+    std::unique_ptr<TRewindBuffer> RewindBuffer;
+    std::unique_ptr<TTraceBuffer> Trace;
+    std::unique_ptr<TTraceFileWriter> TraceFile;
+    std::unique_ptr<TExecutionCounters> Counters;
+    std::string CountersPath;
+    std::atomic<bool> CountersDumpRequested {false};
+    std::unique_ptr<TSamplingProfiler> Sampler;
+    TEventTracer* Events = nullptr;
 private:
     void ResetState();
+    void TickTimers();
+    void SetTone(bool enabled);
 
 };
 
@@ -0,0 +1,155 @@
+#include <map>
+#include <thread>
+#include <vector>
+#include <SFML/Graphics/Sprite.hpp>
+#include <SFML/Graphics/Texture.hpp>
+#include <SFML/Window/Event.hpp>
+#include "sfml.h"
+
+namespace {
+    const unsigned ToneSampleRate = 44100;
+    const unsigned ToneFrequency = 440;
+
+    const std::map<sf::Keyboard::Key, uint8_t>& Buttons() {
+        static const std::map<sf::Keyboard::Key, uint8_t> buttons {
+                {sf::Keyboard::Key::Num1, 1 },
+                {sf::Keyboard::Key::Num2, 2 },
+                {sf::Keyboard::Key::Num3, 3 },
+                {sf::Keyboard::Key::Num4, 0xC },
+                {sf::Keyboard::Key::Q, 4 },
+                {sf::Keyboard::Key::W, 5 },
+                {sf::Keyboard::Key::E, 6 },
+                {sf::Keyboard::Key::R, 0xD },
+                {sf::Keyboard::Key::A, 7 },
+                {sf::Keyboard::Key::S, 8 },
+                {sf::Keyboard::Key::D, 9 },
+                {sf::Keyboard::Key::F, 0xE },
+                {sf::Keyboard::Key::Z, 0xA },
+                {sf::Keyboard::Key::X, 0 },
+                {sf::Keyboard::Key::C, 0xD },
+                {sf::Keyboard::Key::V, 0xF },
+        };
+        return buttons;
+    }
+}
+
+
+TSfmlFrontend::TSfmlFrontend()
+    : Screen(sf::VideoMode(640, 320), "CHIP-8", sf::Style::Close)
+{
+    // One second of a square wave, looped while the sound timer runs
+    std::vector<sf::Int16> samples(ToneSampleRate);
+    for (size_t i = 0; i < samples.size(); ++i) {
+        samples[i] = (i * ToneFrequency * 2 / ToneSampleRate) % 2 ? 8000 : -8000;
+    }
+    ToneBuffer.loadFromSamples(samples.data(), samples.size(), 1, ToneSampleRate);
+    Tone.setBuffer(ToneBuffer);
+    Tone.setLoop(true);
+}
+
+void TSfmlFrontend::Run() {
+    if (Events) {
+        Events->SetThreadName("window");
+    }
+    const size_t width = ScreenWidth;
+    const size_t height = ScreenHeight;
+
+    // The whole screen is one 64x32 texture scaled up by a single sprite: one draw call
+    // per frame and nothing that needs more than basic (software) OpenGL
+    sf::Texture texture;
+    texture.create(width, height);
+    texture.setSmooth(false);
+    sf::Sprite sprite(texture);
+    sprite.setScale(10, 10);
+
+    std::vector<sf::Uint8> pixels(width * height * 4, 0xFF);
+    bool firstFrame = true;
+
+    while (Screen.isOpen()) {
+        sf::Event event;
+        while (Screen.pollEvent(event)) {
+            if (event.type == sf::Event::Closed) {
+                Screen.close();
+            }
+            else if (event.type == sf::Event::KeyPressed) {
+                const auto button = Buttons().find(event.key.code);
+                if (button != Buttons().end()) {
+                    PressKey(button->second);
+                } else if (event.key.code == sf::Keyboard::BackSpace && RewindHandler) {
+                    RewindHandler();
+                }
+            }
+        }
+        if (!Screen.isOpen()) {
+            break;
+        }
+
+        UpdateTone();
+
+        {
+            TEventScope render(Events, "Render");
+            if (Frames.Update() || firstFrame) {
+                const auto& frame = Frames.Read();
+                for (size_t y = 0; y < height; ++y) {
+                    for (size_t x = 0; x < width; ++x) {
+                        const sf::Uint8 value = GetPixel(frame, x, y) ? 0xFF : 0x00;
+                        sf::Uint8* pixel = &pixels[(y * width + x) * 4];
+                        pixel[0] = value;
+                        pixel[1] = value;
+                        pixel[2] = value;
+                    }
+                }
+                texture.update(pixels.data());
+                firstFrame = false;
+            }
+
+            Screen.clear();
+            Screen.draw(sprite);
+            Screen.display();
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(1000/60));
+    }
+
+    Tone.stop();
+    Closed = true;
+}
+
+void TSfmlFrontend::SetTone(bool enabled) {
+    // Applied by the window thread, which owns the sound
+    ToneEnabled = enabled;
+}
+
+void TSfmlFrontend::UpdateTone() {
+    const bool enabled = ToneEnabled;
+    if (enabled == TonePlaying) {
+        return;
+    }
+    if (enabled) {
+        Tone.play();
+    } else {
+        Tone.stop();
+    }
+    TonePlaying = enabled;
+}
+
+void TSfmlFrontend::Poll(uint64_t, TPendingKeys& keys) {
+    const auto lock = LockTraced(Events, KeyAccess, "Wait KeyAccess");
+    if (PendingKey) {
+        keys = {};
+        keys.push(*PendingKey);
+        PendingKey = boost::none;
+    }
+}
+
+bool TSfmlFrontend::IsOpen() const {
+    return !Closed;
+}
+
+void TSfmlFrontend::PressKey(uint8_t key) {
+    if (Events) {
+        Events->Instant("Key press");
+    }
+    const auto lock = LockTraced(Events, KeyAccess, "Wait KeyAccess");
+    PendingKey = key;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <boost/optional.hpp>
+#include <SFML/Audio.hpp>
+#include <SFML/Graphics/RenderWindow.hpp>
+#include <io/audio.h>
+#include <io/input.h>
+#include <io/video.h>
+#include <trace/events.h>
+
+// Window, keyboard and speaker for an interactive session. The window has to live
+// on the thread that calls Run(); the machine talks to it from its own thread.
+class TSfmlFrontend : public IAudioSink, public IInputSource {
+public:
+    TSfmlFrontend();
+
+    IVideoSink& GetVideoSink() {
+        return Frames;
+    }
+
+    // Called on the window thread each time Backspace is pressed or repeats
+    void SetRewindHandler(std::function<void()> handler) {
+        RewindHandler = std::move(handler);
+    }
+
+    // Not owned; records rendered frames, key presses and contended key-lock waits
+    void SetEventTracer(TEventTracer* events) {
+        Events = events;
+    }
+
+    // Event loop and rendering until the window is closed; closes the input afterwards
+    void Run();
+
+    void SetTone(bool enabled) override;
+
+    void Poll(uint64_t cycle, TPendingKeys& keys) override;
+    bool IsOpen() const override;
+
+private:
+    sf::RenderWindow Screen;
+    TFrameExchange Frames;
+
+    sf::SoundBuffer ToneBuffer;
+    sf::Sound Tone;
+    std::atomic<bool> ToneEnabled {false};
+    bool TonePlaying = false;
+
+    std::mutex KeyAccess;
+    boost::optional<uint8_t> PendingKey;
+    std::atomic<bool> Closed {false};
+    std::function<void()> RewindHandler;
+    TEventTracer* Events = nullptr;
+private:
+    void PressKey(uint8_t key);
+    void UpdateTone();
+};
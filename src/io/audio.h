@@ -0,0 +1,9 @@
+#pragma once
+
+class IAudioSink {
+public:
+    virtual ~IAudioSink() = default;
+
+    // Called when the sound timer starts or stops the buzzer
+    virtual void SetTone(bool enabled) = 0;
+};
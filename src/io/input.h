@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdint>
+#include <stdexcept>
+#include <utils/fixed_containers.h>
+
+// Thrown out of the CPU when a program waits for a key and the input can never deliver one
+class TInputClosed : public std::runtime_error {
+public:
+    TInputClosed()
+        : std::runtime_error("Waiting for a key but the input is closed")
+    {}
+};
+
+// Presses the CPU hasn't consumed yet, oldest first
+using TPendingKeys = TFixedQueue<uint8_t, 16>;
+
+class IInputSource {
+public:
+    virtual ~IInputSource() = default;
+
+    // Called on the CPU thread before a key instruction executed at `cycle`;
+    // moves pending presses into `keys`
+    virtual void Poll(uint64_t cycle, TPendingKeys& keys) = 0;
+
+    // False once no more key presses will ever arrive
+    virtual bool IsOpen() const = 0;
+};
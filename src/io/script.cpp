@@ -0,0 +1,80 @@
+#include "script.h"
+
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+std::vector<TInputEvent> ReadInputScript(std::istream& input) {
+    std::vector<TInputEvent> events;
+    std::string line;
+    for (size_t lineNumber = 1; std::getline(input, line); ++lineNumber) {
+        line = line.substr(0, line.find('#'));
+        std::istringstream fields(line);
+        uint64_t cycle;
+        unsigned key;
+        if (!(fields >> cycle)) {
+            continue;
+        }
+        if (!(fields >> std::hex >> key) || key > 0xF) {
+            throw std::runtime_error("Bad key in input script at line " + std::to_string(lineNumber));
+        }
+        if (!events.empty() && cycle < events.back().Cycle) {
+            throw std::runtime_error("Input script goes back in time at line " + std::to_string(lineNumber));
+        }
+        events.push_back({cycle, static_cast<uint8_t>(key)});
+    }
+    return events;
+}
+
+void WriteInputScript(std::ostream& output, const std::vector<TInputEvent>& events) {
+    output << "# cycle key\n";
+    for (const auto& event : events) {
+        output << event.Cycle << ' ' << std::hex << std::uppercase << unsigned(event.Key)
+               << std::dec << std::nouppercase << '\n';
+    }
+}
+
+TScriptedInput::TScriptedInput(std::vector<TInputEvent> events)
+    : Events(std::move(events))
+{}
+
+void TScriptedInput::Poll(uint64_t cycle, TPendingKeys& keys) {
+    // Like a keyboard, a newer press replaces whatever was not consumed yet
+    for (; Next < Events.size() && Events[Next].Cycle <= cycle; ++Next) {
+        keys = {};
+        keys.push(Events[Next].Key);
+    }
+}
+
+bool TScriptedInput::IsOpen() const {
+    return Next < Events.size();
+}
+
+TRecordingInput::TRecordingInput(IInputSource* source)
+    : Source(source)
+{}
+
+void TRecordingInput::Poll(uint64_t cycle, TPendingKeys& keys) {
+    if (cycle < LastCycle) {
+        while (!Events.empty() && Events.back().Cycle >= cycle) {
+            Events.pop_back();
+        }
+    }
+    LastCycle = cycle;
+    if (!Source) {
+        return;
+    }
+
+    // Delivered with the same replace-pending rule TScriptedInput uses, so a replay matches
+    TPendingKeys pressed {};
+    Source->Poll(cycle, pressed);
+    for (; !pressed.empty(); pressed.pop()) {
+        Events.push_back({cycle, pressed.front()});
+        keys = {};
+        keys.push(pressed.front());
+    }
+}
+
+bool TRecordingInput::IsOpen() const {
+    return Source && Source->IsOpen();
+}
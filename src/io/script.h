@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <vector>
+#include <io/input.h>
+
+struct TInputEvent {
+    uint64_t Cycle;
+    uint8_t Key;
+};
+
+// Text form: one "<cycle> <key>" pair per line, the key in hex; '#' starts a comment
+std::vector<TInputEvent> ReadInputScript(std::istream& input);
+void WriteInputScript(std::ostream& output, const std::vector<TInputEvent>& events);
+
+// Presses keys at fixed emulated cycles, so a run with a script is reproducible
+class TScriptedInput : public IInputSource {
+public:
+    explicit TScriptedInput(std::vector<TInputEvent> events);
+
+    void Poll(uint64_t cycle, TPendingKeys& keys) override;
+
+    // Open until the last event has been delivered
+    bool IsOpen() const override;
+
+private:
+    std::vector<TInputEvent> Events;
+    size_t Next = 0;
+};
+
+// Passes another source through and logs each press it delivers with the cycle it was
+// delivered at. Replaying the log with TScriptedInput repeats the run exactly, as long as
+// nothing else in it depends on the host. A poll at an earlier cycle than the last one
+// means the machine was rewound, and the presses from the abandoned future are dropped.
+class TRecordingInput : public IInputSource {
+public:
+    explicit TRecordingInput(IInputSource* source);
+
+    void Poll(uint64_t cycle, TPendingKeys& keys) override;
+    bool IsOpen() const override;
+
+    const std::vector<TInputEvent>& GetEvents() const {
+        return Events;
+    }
+
+private:
+    IInputSource* Source;
+    std::vector<TInputEvent> Events;
+    uint64_t LastCycle = 0;
+};
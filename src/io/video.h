@@ -0,0 +1,49 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include <utils/triple_buffer.h>
+
+const size_t ScreenWidth = 64;
+const size_t ScreenHeight = 32;
+
+// One word per row; the leftmost pixel (x = 0) is the most significant bit
+using TVideoMemory = std::array<uint64_t, ScreenHeight>;
+
+inline bool GetPixel(const TVideoMemory& videoMemory, size_t x, size_t y) {
+    return (videoMemory[y] >> (ScreenWidth - 1 - x)) & 0x1;
+}
+
+class IVideoSink {
+public:
+    virtual ~IVideoSink() = default;
+
+    // Called on the CPU thread with the finished frame after every CLS and DRW
+    virtual void PresentFrame(const TVideoMemory& frame) = 0;
+};
+
+// Hands frames over to another thread through a triple buffer
+class TFrameExchange : public IVideoSink {
+public:
+    TFrameExchange()
+        : Frames(TVideoMemory {})
+    {}
+
+    void PresentFrame(const TVideoMemory& frame) override {
+        Frames.Publish(frame);
+    }
+
+    // Reader side: takes the newest frame, returns whether it differs from the last one read
+    bool Update() {
+        return Frames.Update();
+    }
+
+    const TVideoMemory& Read() const {
+        return Frames.Read();
+    }
+
+private:
+    TTripleBuffer<TVideoMemory> Frames;
+};
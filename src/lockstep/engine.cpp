@@ -0,0 +1,366 @@
+#include "engine.h"
+
+#include <stdexcept>
+#include <opcode/parser.h>
+
+namespace {
+    // dst = mask ? value(lane) : dst, for every lane. The values are computed into a
+    // temporary first, so `value` may read `dst` itself (e.g. Vx = Vx + Vy with x == y),
+    // and the blend works on local copies the compiler knows alias nothing
+    template <typename T, size_t Lanes, typename TValue>
+    void Update(std::array<T, Lanes>& dst, const std::array<uint8_t, Lanes>& mask, TValue value) {
+        std::array<T, Lanes> result;
+        for (size_t lane = 0; lane < Lanes; ++lane) {
+            result[lane] = static_cast<T>(value(lane));
+        }
+        const auto select = mask;
+        auto current = dst;
+        for (size_t lane = 0; lane < Lanes; ++lane) {
+            const T bits = static_cast<T>(-static_cast<T>(select[lane] & 0x1));
+            current[lane] = static_cast<T>((result[lane] & bits) | (current[lane] & ~bits));
+        }
+        dst = current;
+    }
+}
+
+
+template <size_t Lanes>
+TLockstepEngine<Lanes>::TLockstepEngine() {
+    for (size_t lane = 0; lane < Lanes; ++lane) {
+        Machines.emplace_back(new TChip8Machine);
+        Memories[lane] = Machines.back()->State.Memory.data();
+    }
+    Halted.fill(0);
+}
+
+template <size_t Lanes>
+void TLockstepEngine<Lanes>::LoadGame(const std::string& filePath) {
+    for (auto& machine : Machines) {
+        machine->LoadGame(filePath);
+    }
+}
+
+template <size_t Lanes>
+void TLockstepEngine<Lanes>::SetInstructionsPerTick(uint32_t instructions) {
+    if (instructions == 0) {
+        throw std::invalid_argument("At least one instruction per timer tick is required");
+    }
+    InstructionsPerTick = instructions;
+}
+
+template <size_t Lanes>
+void TLockstepEngine<Lanes>::Run(uint64_t instructions) {
+    LoadLanes();
+    try {
+        for (; instructions > 0; --instructions) {
+            Step();
+        }
+    } catch (...) {
+        StoreLanes();
+        throw;
+    }
+    StoreLanes();
+}
+
+template <size_t Lanes>
+void TLockstepEngine<Lanes>::LoadLanes() {
+    for (size_t lane = 0; lane < Lanes; ++lane) {
+        const auto& state = Machines[lane]->State;
+        for (size_t x = 0; x < V.size(); ++x) {
+            V[x][lane] = state.V[x];
+        }
+        I[lane] = state.I;
+        PC[lane] = state.PC;
+        DT[lane] = state.DT;
+        ST[lane] = state.ST;
+    }
+}
+
+template <size_t Lanes>
+void TLockstepEngine<Lanes>::StoreLanes() {
+    for (size_t lane = 0; lane < Lanes; ++lane) {
+        auto& state = Machines[lane]->State;
+        for (size_t x = 0; x < V.size(); ++x) {
+            state.V[x] = V[x][lane];
+        }
+        state.I = I[lane];
+        state.PC = PC[lane];
+        state.DT = DT[lane];
+        state.ST = ST[lane];
+        if (!Halted[lane]) {
+            state.Cycles = Cycles;
+        }
+    }
+}
+
+template <size_t Lanes>
+void TLockstepEngine<Lanes>::Step() {
+    // Lanes are grouped by PC and by the word there, since lanes that wrote to memory may
+    // hold different code. Every group of two or more runs once on the vector path
+    TLanes<uint16_t> words;
+    TMask pending;
+    for (size_t lane = 0; lane < Lanes; ++lane) {
+        const uint16_t pc = PC[lane] + 1u < MemorySize ? PC[lane] : 0;
+        words[lane] = (Memories[lane][pc] << 8) | Memories[lane][pc + 1];
+        pending[lane] = ~Halted[lane];
+    }
+
+    for (size_t leader = 0; leader < Lanes; ++leader) {
+        if (!pending[leader]) {
+            continue;
+        }
+
+        const auto opcode = TOpcodeParser::Parse(words[leader]);
+        if (!IsVectorizable(opcode.GetOperationType()) || PC[leader] + 1u >= MemorySize) {
+            RunScalar(leader);
+            pending[leader] = 0;
+            continue;
+        }
+
+        TMask group;
+        size_t groupSize = 0;
+        const uint16_t pc = PC[leader];
+        const uint16_t word = words[leader];
+        for (size_t lane = 0; lane < Lanes; ++lane) {
+            group[lane] = pending[lane] & -static_cast<uint8_t>((PC[lane] == pc) & (words[lane] == word));
+            groupSize += group[lane] & 0x1;
+        }
+        if (groupSize == 1) {
+            RunScalar(leader);
+            pending[leader] = 0;
+            continue;
+        }
+
+        Update(PC, group, [this](size_t lane) { return PC[lane] + 2; });
+        RunVector(opcode, group);
+
+        for (size_t lane = 0; lane < Lanes; ++lane) {
+            pending[lane] &= ~group[lane];
+        }
+        LockstepInstructions += groupSize;
+    }
+
+    ++Cycles;
+    if (Cycles % InstructionsPerTick == 0) {
+        TickTimers();
+    }
+}
+
+template <size_t Lanes>
+bool TLockstepEngine<Lanes>::IsVectorizable(EOperationType type) {
+    switch (type) {
+        case EOperationType::JUMP:
+        case EOperationType::SE_CONST:
+        case EOperationType::SNE_CONST:
+        case EOperationType::SE_VAR:
+        case EOperationType::SNE_VAR:
+        case EOperationType::LD_CONST:
+        case EOperationType::ADD_CONST:
+        case EOperationType::LD_VAR:
+        case EOperationType::OR_VAR:
+        case EOperationType::AND_VAR:
+        case EOperationType::XOR_VAR:
+        case EOperationType::ADD_VAR:
+        case EOperationType::SUB_VAR:
+        case EOperationType::SHR_VAR:
+        case EOperationType::SUBN_VAR:
+        case EOperationType::SHL_VAR:
+        case EOperationType::LD_ADDR:
+        case EOperationType::ADD_ADDR:
+        case EOperationType::STORE_DT:
+        case EOperationType::STORE_ST:
+        case EOperationType::LD_DT:
+        case EOperationType::LD_ST:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Each case mirrors the TCPU handler of the same operation statement by statement, so
+// flag and aliasing quirks (x or y being VF, x == y) come out the same
+template <size_t Lanes>
+void TLockstepEngine<Lanes>::RunVector(const TOpcode& opcode, const TMask& mask) {
+    auto& vf = V[0xF];
+    switch (opcode.GetOperationType()) {
+        case EOperationType::JUMP: {
+            const uint16_t address = opcode.GetArgs<TAddress>().Value;
+            Update(PC, mask, [address](size_t) { return address; });
+            break;
+        }
+        case EOperationType::SE_CONST: {
+            const auto args = opcode.GetArgs<TVarWithConst>();
+            const auto& vx = V.at(args.X);
+            Update(PC, mask, [&](size_t lane) { return PC[lane] + (vx[lane] == args.Const ? 2 : 0); });
+            break;
+        }
+        case EOperationType::SNE_CONST: {
+            const auto args = opcode.GetArgs<TVarWithConst>();
+            const auto& vx = V.at(args.X);
+            Update(PC, mask, [&](size_t lane) { return PC[lane] + (vx[lane] != args.Const ? 2 : 0); });
+            break;
+        }
+        case EOperationType::SE_VAR:
+        case EOperationType::SNE_VAR: {
+            // TCPU::SkipIfNotEqualToVar skips on equality too
+            const auto args = opcode.GetArgs<TTwoVars>();
+            const auto& vx = V.at(args.X);
+            const auto& vy = V.at(args.Y);
+            Update(PC, mask, [&](size_t lane) { return PC[lane] + (vx[lane] == vy[lane] ? 2 : 0); });
+            break;
+        }
+        case EOperationType::LD_CONST: {
+            const auto args = opcode.GetArgs<TVarWithConst>();
+            Update(V.at(args.X), mask, [&](size_t) { return args.Const; });
+            break;
+        }
+        case EOperationType::ADD_CONST: {
+            const auto args = opcode.GetArgs<TVarWithConst>();
+            auto& vx = V.at(args.X);
+            Update(vx, mask, [&](size_t lane) { return vx[lane] + args.Const; });
+            break;
+        }
+        case EOperationType::LD_VAR: {
+            const auto args = opcode.GetArgs<TTwoVars>();
+            const auto& vy = V.at(args.Y);
+            Update(V.at(args.X), mask, [&](size_t lane) { return vy[lane]; });
+            break;
+        }
+        case EOperationType::OR_VAR: {
+            const auto args = opcode.GetArgs<TTwoVars>();
+            auto& vx = V.at(args.X);
+            const auto& vy = V.at(args.Y);
+            Update(vx, mask, [&](size_t lane) { return vx[lane] | vy[lane]; });
+            break;
+        }
+        case EOperationType::AND_VAR: {
+            const auto args = opcode.GetArgs<TTwoVars>();
+            auto& vx = V.at(args.X);
+            const auto& vy = V.at(args.Y);
+            Update(vx, mask, [&](size_t lane) { return vx[lane] & vy[lane]; });
+            break;
+        }
+        case EOperationType::XOR_VAR: {
+            const auto args = opcode.GetArgs<TTwoVars>();
+            auto& vx = V.at(args.X);
+            const auto& vy = V.at(args.Y);
+            Update(vx, mask, [&](size_t lane) { return vx[lane] ^ vy[lane]; });
+            break;
+        }
+        case EOperationType::ADD_VAR: {
+            const auto args = opcode.GetArgs<TTwoVars>();
+            auto& vx = V.at(args.X);
+            const auto& vy = V.at(args.Y);
+            TLanes<uint16_t> sum;
+            for (size_t lane = 0; lane < Lanes; ++lane) {
+                sum[lane] = vx[lane] + vy[lane];
+            }
+            Update(vx, mask, [&](size_t lane) { return sum[lane] & 0x00FF; });
+            Update(vf, mask, [&](size_t lane) { return sum[lane] >= 0xFF; });
+            break;
+        }
+        case EOperationType::SUB_VAR: {
+            const auto args = opcode.GetArgs<TTwoVars>();
+            auto& vx = V.at(args.X);
+            const auto& vy = V.at(args.Y);
+            Update(vf, mask, [&](size_t lane) { return vx[lane] >= vy[lane]; });
+            Update(vx, mask, [&](size_t lane) { return vx[lane] - vy[lane]; });
+            break;
+        }
+        case EOperationType::SUBN_VAR: {
+            const auto args = opcode.GetArgs<TTwoVars>();
+            auto& vx = V.at(args.X);
+            const auto& vy = V.at(args.Y);
+            Update(vf, mask, [&](size_t lane) { return vy[lane] >= vx[lane]; });
+            Update(vx, mask, [&](size_t lane) { return vy[lane] - vx[lane]; });
+            break;
+        }
+        case EOperationType::SHR_VAR: {
+            const auto args = opcode.GetArgs<TTwoVars>();
+            const auto operand = V.at(args.Y);
+            Update(V.at(args.X), mask, [&](size_t lane) { return operand[lane] >> 1; });
+            Update(vf, mask, [&](size_t lane) { return operand[lane] & 0x1; });
+            break;
+        }
+        case EOperationType::SHL_VAR: {
+            const auto args = opcode.GetArgs<TTwoVars>();
+            const auto operand = V.at(args.Y);
+            Update(V.at(args.X), mask, [&](size_t lane) { return operand[lane] << 1; });
+            Update(vf, mask, [&](size_t lane) { return static_cast<uint16_t>(operand[lane]) & 0x8000; });
+            break;
+        }
+        case EOperationType::LD_ADDR: {
+            const uint16_t address = opcode.GetArgs<TAddress>().Value;
+            Update(I, mask, [address](size_t) { return address; });
+            break;
+        }
+        case EOperationType::ADD_ADDR: {
+            const auto& vx = V.at(opcode.GetArgs<TVar>().X);
+            Update(I, mask, [&](size_t lane) { return I[lane] + vx[lane]; });
+            break;
+        }
+        case EOperationType::STORE_DT: {
+            const auto& vx = V.at(opcode.GetArgs<TVar>().X);
+            Update(DT, mask, [&](size_t lane) { return vx[lane]; });
+            break;
+        }
+        case EOperationType::STORE_ST: {
+            const auto& vx = V.at(opcode.GetArgs<TVar>().X);
+            Update(ST, mask, [&](size_t lane) { return vx[lane]; });
+            break;
+        }
+        case EOperationType::LD_DT: {
+            Update(V.at(opcode.GetArgs<TVar>().X), mask, [&](size_t lane) { return DT[lane]; });
+            break;
+        }
+        case EOperationType::LD_ST: {
+            Update(V.at(opcode.GetArgs<TVar>().X), mask, [&](size_t lane) { return ST[lane]; });
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+template <size_t Lanes>
+void TLockstepEngine<Lanes>::RunScalar(size_t lane) {
+    auto& machine = *Machines[lane];
+    auto& state = machine.State;
+    for (size_t x = 0; x < V.size(); ++x) {
+        state.V[x] = V[x][lane];
+    }
+    state.I = I[lane];
+    state.PC = PC[lane];
+    state.DT = DT[lane];
+    state.ST = ST[lane];
+    state.Cycles = Cycles;
+
+    try {
+        machine.Cpu.Step();
+    } catch (const TInputClosed&) {
+        Halted[lane] = 0xFF;
+    }
+    ++ScalarInstructions;
+
+    for (size_t x = 0; x < V.size(); ++x) {
+        V[x][lane] = state.V[x];
+    }
+    I[lane] = state.I;
+    PC[lane] = state.PC;
+    DT[lane] = state.DT;
+    ST[lane] = state.ST;
+}
+
+template <size_t Lanes>
+void TLockstepEngine<Lanes>::TickTimers() {
+    TMask running;
+    for (size_t lane = 0; lane < Lanes; ++lane) {
+        running[lane] = ~Halted[lane];
+    }
+    Update(DT, running, [this](size_t lane) { return DT[lane] > 0 ? DT[lane] - 1 : 0; });
+    Update(ST, running, [this](size_t lane) { return ST[lane] > 0 ? ST[lane] - 1 : 0; });
+}
+
+template class TLockstepEngine<8>;
+template class TLockstepEngine<16>;
+template class TLockstepEngine<32>;
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <vector>
+#include <chip8.h>
+
+// Runs Lanes copies of a machine in lockstep, for workloads that run one ROM with
+// different inputs. Registers and timers are kept as structure of arrays, one lane per
+// machine, so an instruction that several lanes are at (same PC and same word) is decoded
+// once and executed for all of them by plain loops over the lanes, which the compiler
+// turns into vector code (AVX2 with -DCHIP8_NATIVE=ON on such hosts). Instructions that
+// touch memory, the screen, the stack, input or RND are executed one lane at a time by
+// that lane's own TChip8Machine::TCPU.
+template <size_t Lanes>
+class TLockstepEngine {
+    static_assert(Lanes == 8 || Lanes == 16 || Lanes == 32, "Lockstep engines have 8, 16 or 32 lanes");
+public:
+    TLockstepEngine();
+
+    void LoadGame(const std::string& filePath);
+    void SetInstructionsPerTick(uint32_t instructions);
+
+    // Per-lane setup (input sources, initial state) goes through the lane's machine.
+    // Its timers follow this engine's clock, not its own Run/Execute
+    TChip8Machine& GetMachine(size_t lane) {
+        return *Machines.at(lane);
+    }
+
+    // Every lane that is not halted runs exactly `instructions` instructions
+    void Run(uint64_t instructions);
+
+    // A lane halts for good when it waits for a key its input can no longer deliver
+    bool IsHalted(size_t lane) const {
+        return Halted.at(lane) != 0;
+    }
+
+    uint64_t GetCycles() const {
+        return Cycles;
+    }
+
+    // Lane-instructions executed by the vector path and by the per-lane fallback
+    uint64_t GetLockstepInstructions() const {
+        return LockstepInstructions;
+    }
+
+    uint64_t GetScalarInstructions() const {
+        return ScalarInstructions;
+    }
+
+private:
+    template <typename T>
+    using TLanes = std::array<T, Lanes>;
+
+    // All-ones for the lanes an operation applies to, zero for the others
+    using TMask = TLanes<uint8_t>;
+
+    static constexpr size_t MemorySize = std::tuple_size<decltype(TChip8Machine::TState::Memory)>::value;
+
+    std::vector<std::unique_ptr<TChip8Machine>> Machines;
+    TLanes<const uint8_t*> Memories;
+    std::array<TLanes<uint8_t>, 16> V;
+    TLanes<uint16_t> I;
+    TLanes<uint16_t> PC;
+    TLanes<uint8_t> DT;
+    TLanes<uint8_t> ST;
+    TMask Halted;
+
+    uint64_t Cycles = 0;
+    uint32_t InstructionsPerTick = TChip8Machine::DefaultInstructionsPerTick;
+    uint64_t LockstepInstructions = 0;
+    uint64_t ScalarInstructions = 0;
+private:
+    void LoadLanes();
+    void StoreLanes();
+    void Step();
+    static bool IsVectorizable(EOperationType type);
+    void RunVector(const TOpcode& opcode, const TMask& mask);
+    void RunScalar(size_t lane);
+    void TickTimers();
+};
+
+extern template class TLockstepEngine<8>;
+extern template class TLockstepEngine<16>;
+extern template class TLockstepEngine<32>;
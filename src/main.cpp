@@ -1,16 +1,189 @@
+#include <csignal>
+#include <fstream>
 #include <iostream>
+#include <limits>
+#include <memory>
+#include <string>
+#include <thread>
 #include "chip8.h"
+#include <io/script.h>
+#ifdef CHIP8_WITH_SFML
+#include <frontend/sfml.h>
+#endif
 
 using namespace std;
 
+namespace {
+    TChip8Machine* CountersMachine = nullptr;
+
+    void RequestCountersDump(int) {
+        CountersMachine->RequestCountersDump();
+    }
+
+    // Timer ticks one press of the rewind key goes back; key repeat makes holding it scrub
+    const size_t RewindStep = 10;
+
+    // Runs with `input` as the keyboard, logging the presses it delivers to `recordPath` if set
+    void ExecuteWithInput(TChip8Machine& machine, uint64_t frames, IInputSource* input, const std::string& recordPath) {
+        TRecordingInput recorder(input);
+        machine.SetInputSource(recordPath.empty() ? input : &recorder);
+        machine.Execute(frames);
+        if (!recordPath.empty()) {
+            std::ofstream log(recordPath);
+            WriteInputScript(log, recorder.GetEvents());
+        }
+    }
+
+    // A replayed input log takes the place of the keyboard
+    void RunInWindow(TChip8Machine& machine, uint64_t frames, IInputSource* replay, const std::string& recordPath,
+                     TEventTracer* events) {
+#ifdef CHIP8_WITH_SFML
+        TSfmlFrontend frontend;
+        frontend.SetEventTracer(events);
+        machine.SetVideoSink(&frontend.GetVideoSink());
+        machine.SetAudioSink(&frontend);
+        frontend.SetRewindHandler([&machine]() {
+            machine.RequestRewind(RewindStep);
+        });
+        IInputSource* input = replay ? replay : &frontend;
+
+        // The window stays on the main thread, the machine gets its own
+        std::thread executionThread([&machine, frames, input, &recordPath]() {
+            ExecuteWithInput(machine, frames, input, recordPath);
+        });
+        frontend.Run();
+        machine.Stop();
+        executionThread.join();
+#else
+        std::cerr << "Built without SFML, running headless\n";
+        ExecuteWithInput(machine, frames, replay, recordPath);
+#endif
+    }
+}
+
 int main(int argc, char* argv[]) {
     if (argc < 2) {
-        std::cerr << "Need a game filepath as an argument";
+        std::cerr << "Usage: chip8 [--threaded|--blocks] [--fuse|--fuse-profile] [--trace] [--trace-file=<path>] [--headless] [--instructions-per-tick=<n>] [--speed=<x>|max] [--frames=<n>] [--load-state=<path>] [--save-state=<path>] [--counters=<path>] [--profile=<path>] [--chrome-trace=<path>] [--seed=<n>] [--rewind=<megabytes>] [--record-input=<path>] [--replay-input=<path>] <game filepath>";
         return 1;
     }
 
     TChip8Machine chip8Machine;
-    chip8Machine.LoadGame(argv[1]);
-    chip8Machine.Execute();
+    std::string gamePath;
+    bool printFusionReport = false;
+    bool headless = false;
+    uint64_t frames = std::numeric_limits<uint64_t>::max();
+    std::string loadStatePath;
+    std::string saveStatePath;
+    std::string recordInputPath;
+    std::string replayInputPath;
+    std::string profilePath;
+    std::string chromeTracePath;
+    std::unique_ptr<TEventTracer> events;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--threaded") {
+            chip8Machine.SetCpuBackend(TChip8Machine::ECpuBackend::Threaded);
+        } else if (arg == "--blocks") {
+            chip8Machine.SetCpuBackend(TChip8Machine::ECpuBackend::Blocks);
+        } else if (arg == "--fuse") {
+            chip8Machine.SetFusionMode(TChip8Machine::EFusionMode::On);
+        } else if (arg == "--fuse-profile") {
+            chip8Machine.SetFusionMode(TChip8Machine::EFusionMode::Profile);
+            printFusionReport = true;
+        } else if (arg == "--trace") {
+            chip8Machine.EnableTrace(1 << 16);
+        } else if (arg.compare(0, 13, "--trace-file=") == 0) {
+            chip8Machine.EnableTraceFile(arg.substr(13));
+        } else if (arg.compare(0, 24, "--instructions-per-tick=") == 0) {
+            chip8Machine.SetInstructionsPerTick(std::stoul(arg.substr(24)));
+        } else if (arg == "--speed=max") {
+            chip8Machine.SetSpeed(TChip8Machine::Unthrottled);
+        } else if (arg.compare(0, 8, "--speed=") == 0) {
+            chip8Machine.SetSpeed(std::stod(arg.substr(8)));
+        } else if (arg.compare(0, 9, "--frames=") == 0) {
+            frames = std::stoull(arg.substr(9));
+        } else if (arg.compare(0, 13, "--load-state=") == 0) {
+            loadStatePath = arg.substr(13);
+        } else if (arg.compare(0, 13, "--save-state=") == 0) {
+            saveStatePath = arg.substr(13);
+        } else if (arg.compare(0, 11, "--counters=") == 0) {
+            chip8Machine.EnableCountersFile(arg.substr(11));
+            // kill -USR1 writes the counters so far without stopping the run
+            CountersMachine = &chip8Machine;
+            std::signal(SIGUSR1, RequestCountersDump);
+        } else if (arg.compare(0, 10, "--profile=") == 0) {
+            profilePath = arg.substr(10);
+            chip8Machine.EnableSampling();
+        } else if (arg.compare(0, 15, "--chrome-trace=") == 0) {
+            chromeTracePath = arg.substr(15);
+            events.reset(new TEventTracer);
+            chip8Machine.SetEventTracer(events.get());
+        } else if (arg.compare(0, 7, "--seed=") == 0) {
+            chip8Machine.SetRandomSeed(std::stoull(arg.substr(7)));
+        } else if (arg.compare(0, 9, "--rewind=") == 0) {
+            chip8Machine.EnableRewind(std::stoull(arg.substr(9)) << 20);
+        } else if (arg.compare(0, 15, "--record-input=") == 0) {
+            recordInputPath = arg.substr(15);
+        } else if (arg.compare(0, 15, "--replay-input=") == 0) {
+            replayInputPath = arg.substr(15);
+        } else if (arg == "--headless") {
+            headless = true;
+        } else {
+            gamePath = arg;
+        }
+    }
+
+    chip8Machine.LoadGame(gamePath);
+    if (!loadStatePath.empty()) {
+        std::ifstream state(loadStatePath, std::ios::binary);
+        chip8Machine.LoadState(ReadSnapshot(state));
+    }
+
+    std::unique_ptr<TScriptedInput> replay;
+    if (!replayInputPath.empty()) {
+        std::ifstream log(replayInputPath);
+        replay.reset(new TScriptedInput(ReadInputScript(log)));
+    }
+
+    if (headless) {
+        // No window and no keyboard: runs until the program waits for a key the replay doesn't have
+        ExecuteWithInput(chip8Machine, frames, replay.get(), recordInputPath);
+    } else {
+        RunInWindow(chip8Machine, frames, replay.get(), recordInputPath, events.get());
+    }
+
+    if (!saveStatePath.empty()) {
+        std::ofstream state(saveStatePath, std::ios::binary);
+        WriteSnapshot(state, chip8Machine.SaveState());
+    }
+
+    chip8Machine.DumpCounters();
+
+    if (events) {
+        // Every recording thread has finished by now; open in chrome://tracing or Perfetto
+        std::ofstream trace(chromeTracePath);
+        events->Write(trace);
+    }
+
+    if (!profilePath.empty()) {
+        // Folded stacks, e.g. for flamegraph.pl
+        std::ofstream profile(profilePath);
+        chip8Machine.GetSampler()->WriteFolded(profile);
+    }
+
+    if (chip8Machine.GetTrace()) {
+        chip8Machine.GetTrace()->Dump(std::cerr);
+    }
+
+    if (printFusionReport) {
+        uint64_t saved = 0;
+        std::cerr << "Fusions for " << gamePath << ":\n";
+        for (const auto& stat : chip8Machine.GetFusionStats()) {
+            std::cerr << "  " << stat.Name << ": " << stat.Hits << " hits, "
+                      << stat.DispatchesSaved << " dispatches saved\n";
+            saved += stat.DispatchesSaved;
+        }
+        std::cerr << "Total dispatches saved: " << saved << '\n';
+    }
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,113 @@
+#include "disasm.h"
+
+#include <ios>
+#include <sstream>
+
+namespace {
+    std::string Hex(const uint16_t word) {
+        std::stringstream ss;
+        ss << std::hex << std::uppercase << word;
+        return ss.str();
+    }
+
+    std::string Var(const uint8_t x) {
+        return "V" + Hex(x);
+    }
+
+    std::string VarWithConst(const char* mnemonic, const TOpcode& opcode) {
+        const auto& args = opcode.GetArgs<TVarWithConst>();
+        return std::string(mnemonic) + " " + Var(args.X) + ", " + Hex(args.Const);
+    }
+
+    std::string TwoVars(const char* mnemonic, const TOpcode& opcode) {
+        const auto& args = opcode.GetArgs<TTwoVars>();
+        return std::string(mnemonic) + " " + Var(args.X) + ", " + Var(args.Y);
+    }
+}
+
+std::string Disassemble(const TOpcode& opcode) {
+    switch (opcode.GetOperationType()) {
+        case EOperationType::UNKNOWN:   return "???";
+        case EOperationType::CLS:       return "CLS";
+        case EOperationType::RET:       return "RET";
+        case EOperationType::JUMP:      return "JP " + Hex(opcode.GetArgs<TAddress>().Value);
+        case EOperationType::CALL:      return "CALL " + Hex(opcode.GetArgs<TAddress>().Value);
+        case EOperationType::SE_CONST:  return VarWithConst("SE", opcode);
+        case EOperationType::SNE_CONST: return VarWithConst("SNE", opcode);
+        case EOperationType::SE_VAR:    return TwoVars("SE", opcode);
+        case EOperationType::SNE_VAR:   return TwoVars("SNE", opcode);
+        case EOperationType::SE_KEY:    return "SKP " + Var(opcode.GetArgs<TVar>().X);
+        case EOperationType::SNE_KEY:   return "SKNP " + Var(opcode.GetArgs<TVar>().X);
+        case EOperationType::LD_CONST:  return VarWithConst("LD", opcode);
+        case EOperationType::ADD_CONST: return VarWithConst("ADD", opcode);
+        case EOperationType::LD_VAR:    return TwoVars("LD", opcode);
+        case EOperationType::OR_VAR:    return TwoVars("OR", opcode);
+        case EOperationType::AND_VAR:   return TwoVars("AND", opcode);
+        case EOperationType::XOR_VAR:   return TwoVars("XOR", opcode);
+        case EOperationType::ADD_VAR:   return TwoVars("ADD", opcode);
+        case EOperationType::SUB_VAR:   return TwoVars("SUB", opcode);
+        case EOperationType::SHR_VAR:   return TwoVars("SHR", opcode);
+        case EOperationType::SUBN_VAR:  return TwoVars("SUBN", opcode);
+        case EOperationType::SHL_VAR:   return TwoVars("SHL", opcode);
+        case EOperationType::LD_ADDR:   return "LD I, " + Hex(opcode.GetArgs<TAddress>().Value);
+        case EOperationType::RND:       return VarWithConst("RND", opcode);
+        case EOperationType::DRAW: {
+            const auto& args = opcode.GetArgs<TTwoVarsWithConst>();
+            return "DRW " + Var(args.X) + ", " + Var(args.Y) + ", " + Hex(args.Const);
+        }
+        case EOperationType::LD_ST:     return "LD " + Var(opcode.GetArgs<TVar>().X) + ", ST";
+        case EOperationType::LD_DT:     return "LD " + Var(opcode.GetArgs<TVar>().X) + ", DT";
+        case EOperationType::LD_KEY:    return "LD " + Var(opcode.GetArgs<TVar>().X) + ", K";
+        case EOperationType::ADD_ADDR:  return "ADD I, " + Var(opcode.GetArgs<TVar>().X);
+        case EOperationType::LD_MEM:    return "LD V0.." + Var(opcode.GetArgs<TVar>().X) + ", [I]";
+        case EOperationType::STORE_DT:  return "LD DT, " + Var(opcode.GetArgs<TVar>().X);
+        case EOperationType::STORE_ST:  return "LD ST, " + Var(opcode.GetArgs<TVar>().X);
+        case EOperationType::LD_SPRITE: return "LD F, " + Var(opcode.GetArgs<TVar>().X);
+        case EOperationType::STORE_MEM: return "LD [I], V0.." + Var(opcode.GetArgs<TVar>().X);
+        case EOperationType::STORE_BCD_VAR: return "LD B, " + Var(opcode.GetArgs<TVar>().X);
+    }
+    return "???";
+}
+
+const char* GetOperationName(EOperationType type) {
+    switch (type) {
+#define CHIP8_OPERATION_NAME(name) case EOperationType::name: return #name;
+        CHIP8_OPERATION_NAME(UNKNOWN)
+        CHIP8_OPERATION_NAME(CLS)
+        CHIP8_OPERATION_NAME(RET)
+        CHIP8_OPERATION_NAME(JUMP)
+        CHIP8_OPERATION_NAME(CALL)
+        CHIP8_OPERATION_NAME(SE_CONST)
+        CHIP8_OPERATION_NAME(SE_KEY)
+        CHIP8_OPERATION_NAME(SNE_KEY)
+        CHIP8_OPERATION_NAME(SNE_CONST)
+        CHIP8_OPERATION_NAME(SE_VAR)
+        CHIP8_OPERATION_NAME(LD_CONST)
+        CHIP8_OPERATION_NAME(ADD_CONST)
+        CHIP8_OPERATION_NAME(LD_VAR)
+        CHIP8_OPERATION_NAME(OR_VAR)
+        CHIP8_OPERATION_NAME(AND_VAR)
+        CHIP8_OPERATION_NAME(XOR_VAR)
+        CHIP8_OPERATION_NAME(ADD_VAR)
+        CHIP8_OPERATION_NAME(SUB_VAR)
+        CHIP8_OPERATION_NAME(SHR_VAR)
+        CHIP8_OPERATION_NAME(SUBN_VAR)
+        CHIP8_OPERATION_NAME(SHL_VAR)
+        CHIP8_OPERATION_NAME(SNE_VAR)
+        CHIP8_OPERATION_NAME(LD_ADDR)
+        CHIP8_OPERATION_NAME(RND)
+        CHIP8_OPERATION_NAME(DRAW)
+        CHIP8_OPERATION_NAME(LD_ST)
+        CHIP8_OPERATION_NAME(LD_DT)
+        CHIP8_OPERATION_NAME(LD_KEY)
+        CHIP8_OPERATION_NAME(ADD_ADDR)
+        CHIP8_OPERATION_NAME(LD_MEM)
+        CHIP8_OPERATION_NAME(STORE_DT)
+        CHIP8_OPERATION_NAME(STORE_ST)
+        CHIP8_OPERATION_NAME(LD_SPRITE)
+        CHIP8_OPERATION_NAME(STORE_MEM)
+        CHIP8_OPERATION_NAME(STORE_BCD_VAR)
+#undef CHIP8_OPERATION_NAME
+    }
+    return "UNKNOWN";
+}
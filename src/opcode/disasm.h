@@ -0,0 +1,10 @@
+#pragma once
+
+#include <string>
+
+#include "types.h"
+
+std::string Disassemble(const TOpcode& opcode);
+
+// Name of the enumerator, e.g. "LD_CONST"
+const char* GetOperationName(EOperationType type);
@@ -1,86 +1,77 @@
-#include <map>
-
 #include "parser.h"
 #include <utils/bitutils.h>
-#include <ios>
-#include <sstream>
 
 namespace {
-    template<typename TArgType>
-    std::function<TOpcode(uint16_t)> RegisterOpcode(EOperationType operationType) {
-        return [operationType](uint16_t opcode) {
-            return TOpcode(operationType, TArgType::Parse(opcode));
-        };
-    }
-
-    template<size_t NCount>
-    std::function<TOpcode(uint16_t)> First(std::initializer_list<std::pair<uint16_t, std::function<TOpcode(uint16_t)>>> pairs) {
-        std::map <uint16_t, std::function<TOpcode(uint16_t)>> lastMap;
-        for (const auto& pair : pairs) {
-            lastMap.insert(pair);
+    constexpr EOperationType DecodeOperationType(uint16_t opcode) {
+        switch (GetLastOctet(opcode)) {
+            case 0x0:
+                switch (GetOctetsRange<1, 3>(opcode)) {
+                    case 0x0E0: return EOperationType::CLS;
+                    case 0x0EE: return EOperationType::RET;
+                }
+                break;
+            case 0x1: return EOperationType::JUMP;
+            case 0x2: return EOperationType::CALL;
+            case 0x3: return EOperationType::SE_CONST;
+            case 0x4: return EOperationType::SNE_CONST;
+            case 0x5: return EOperationType::SE_VAR;
+            case 0x6: return EOperationType::LD_CONST;
+            case 0x7: return EOperationType::ADD_CONST;
+            case 0x8:
+                switch (GetOctetAt<1>(opcode)) {
+                    case 0x0: return EOperationType::LD_VAR;
+                    case 0x1: return EOperationType::OR_VAR;
+                    case 0x2: return EOperationType::AND_VAR;
+                    case 0x3: return EOperationType::XOR_VAR;
+                    case 0x4: return EOperationType::ADD_VAR;
+                    case 0x5: return EOperationType::SUB_VAR;
+                    case 0x6: return EOperationType::SHR_VAR;
+                    case 0x7: return EOperationType::SUBN_VAR;
+                    case 0xE: return EOperationType::SHL_VAR;
+                }
+                break;
+            case 0x9: return EOperationType::SNE_VAR;
+            case 0xA: return EOperationType::LD_ADDR;
+            case 0xC: return EOperationType::RND;
+            case 0xD: return EOperationType::DRAW;
+            case 0xE:
+                switch (GetOctetsRange<1, 2>(opcode)) {
+                    case 0x9E: return EOperationType::SE_KEY;
+                    case 0xA1: return EOperationType::SNE_KEY;
+                }
+                break;
+            case 0xF:
+                switch (GetOctetsRange<1, 2>(opcode)) {
+                    case 0x0A: return EOperationType::LD_KEY;
+                    case 0x07: return EOperationType::LD_DT;
+                    case 0x1E: return EOperationType::ADD_ADDR;
+                    case 0x15: return EOperationType::STORE_DT;
+                    case 0x18: return EOperationType::STORE_ST;
+                    case 0x29: return EOperationType::LD_SPRITE;
+                    case 0x33: return EOperationType::STORE_BCD_VAR;
+                    case 0x55: return EOperationType::STORE_MEM;
+                    case 0x65: return EOperationType::LD_MEM;
+                }
+                break;
         }
-         return [lastMap](uint16_t opcode) {
-            auto& func = lastMap.at(GetOctetsRange<1, NCount>(opcode));
-            return func(opcode);
-        };
+        return EOperationType::UNKNOWN;
     }
 
+    struct TDecodeTable {
+        TOpcode Opcodes[0x10000];
+    };
 
+    constexpr TDecodeTable BuildDecodeTable() {
+        TDecodeTable table {};
+        for (uint32_t word = 0; word < 0x10000; ++word) {
+            table.Opcodes[word] = TOpcode::FromWord(DecodeOperationType(word), word);
+        }
+        return table;
+    }
 
-    const std::map<uint8_t, std::function<TOpcode(uint16_t)>> Instructions = {
-            {0x0, First<3>({
-                                   {0x0E0, RegisterOpcode<TEmpty>(EOperationType::CLS)},
-                                   {0x0EE, RegisterOpcode<TEmpty>(EOperationType::RET)}
-                           })},
-            {0x1, RegisterOpcode<TAddress>(EOperationType::JUMP)},
-            {0x2, RegisterOpcode<TAddress>(EOperationType::CALL)},
-            {0x3, RegisterOpcode<TVarWithConst>(EOperationType::SE_CONST)},
-            {0x4, RegisterOpcode<TVarWithConst>(EOperationType::SNE_CONST)},
-            {0x5, RegisterOpcode<TTwoVars>(EOperationType::SE_VAR)},
-            {0x6, RegisterOpcode<TVarWithConst>(EOperationType::LD_CONST)},
-            {0x7, RegisterOpcode<TVarWithConst>(EOperationType::ADD_CONST)},
-            {0x8, First<1>({
-                                   {0x0, RegisterOpcode<TTwoVars>(EOperationType::LD_VAR)},
-                                   {0x1, RegisterOpcode<TTwoVars>(EOperationType::OR_VAR)},
-                                   {0x2, RegisterOpcode<TTwoVars>(EOperationType::AND_VAR)},
-                                   {0x3, RegisterOpcode<TTwoVars>(EOperationType::XOR_VAR)},
-                                   {0x4, RegisterOpcode<TTwoVars>(EOperationType::ADD_VAR)},
-                                   {0x5, RegisterOpcode<TTwoVars>(EOperationType::SUB_VAR)},
-                                   {0x6, RegisterOpcode<TTwoVars>(EOperationType::SHR_VAR)},
-                                   {0x7, RegisterOpcode<TTwoVars>(EOperationType::SUBN_VAR)},
-                                   {0xE, RegisterOpcode<TTwoVars>(EOperationType::SHL_VAR)}
-                           })},
-            {0x9, RegisterOpcode<TTwoVars>(EOperationType::SNE_VAR)},
-            {0xA, RegisterOpcode<TAddress>(EOperationType::LD_ADDR)},
-            {0xC, RegisterOpcode<TVarWithConst>(EOperationType::RND)},
-            {0xD, RegisterOpcode<TTwoVarsWithConst>(EOperationType::DRAW)},
-            {0xE, First<2>({
-                                   {0x9E, RegisterOpcode<TVar>(EOperationType::SE_KEY)},
-                                   {0xA1, RegisterOpcode<TVar>(EOperationType::SNE_KEY)}
-                           })},
-            {0xF, First<2>({
-                                   {0x0A, RegisterOpcode<TVar>(EOperationType::LD_KEY)},
-                                   {0x07, RegisterOpcode<TVar>(EOperationType::LD_DT)},
-                                   {0x1E, RegisterOpcode<TVar>(EOperationType::ADD_ADDR)},
-                                   {0x15, RegisterOpcode<TVar>(EOperationType::STORE_DT)},
-                                   {0x18, RegisterOpcode<TVar>(EOperationType::STORE_ST)},
-                                   {0x29, RegisterOpcode<TVar>(EOperationType::LD_SPRITE)},
-                                   {0x33, RegisterOpcode<TVar>(EOperationType::STORE_BCD_VAR)},
-                                   {0x55, RegisterOpcode<TVar>(EOperationType::STORE_MEM)},
-                                   {0x65, RegisterOpcode<TVar>(EOperationType::LD_MEM)},
-                           })},
-    };
+    constexpr TDecodeTable DecodeTable = BuildDecodeTable();
 }
 
 const TOpcode TOpcodeParser::Parse(uint16_t opcode) {
-    const uint16_t lastOctet = GetLastOctet(opcode);
-    try {
-        const auto& function = Instructions.at(lastOctet);
-        return function(opcode);
-    }
-    catch (...) {
-        std::stringstream ss;
-        ss << "Unknown opcode: " << std::hex << opcode;
-        throw std::logic_error(ss.str());
-    }
+    return DecodeTable.Opcodes[opcode];
 }
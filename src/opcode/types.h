@@ -2,27 +2,25 @@
 
 #include <utils/bitutils.h>
 
-#include <boost/variant.hpp>
-
 struct TEmpty {
-    static TEmpty Parse(uint16_t opcode) {
-        return TEmpty {};
+    constexpr uint16_t Encode() const {
+        return 0;
     }
 };
 
 struct TAddress {
     uint16_t Value;
-    static TAddress Parse(uint16_t opcode) {
-        return TAddress { .Value = GetOctetsRange<1,3>(opcode) };
-    }
 
+    constexpr uint16_t Encode() const {
+        return Value & 0x0FFF;
+    }
 };
 
 struct TVar {
     uint8_t X;
 
-    static TVar Parse(uint16_t opcode) {
-        return TVar { .X = GetOctetAt<3>(opcode) };
+    constexpr uint16_t Encode() const {
+        return (X & 0x0F) << 8;
     }
 };
 
@@ -30,8 +28,8 @@ struct TVarWithConst {
     uint8_t X;
     uint8_t Const;
 
-    static TVarWithConst Parse(uint16_t opcode) {
-        return TVarWithConst { .X = GetOctetAt<3>(opcode), .Const = GetOctetsRange<1,2>(opcode) };
+    constexpr uint16_t Encode() const {
+        return ((X & 0x0F) << 8) | Const;
     }
 };
 
@@ -40,8 +38,8 @@ struct TTwoVarsWithConst {
     uint8_t Y;
     uint8_t Const;
 
-    static TTwoVarsWithConst Parse(uint16_t opcode) {
-        return TTwoVarsWithConst { .X = GetOctetAt<3>(opcode), .Y = GetOctetAt<2>(opcode), .Const = GetOctetAt<1>(opcode) };
+    constexpr uint16_t Encode() const {
+        return ((X & 0x0F) << 8) | ((Y & 0x0F) << 4) | (Const & 0x0F);
     }
 };
 
@@ -49,12 +47,13 @@ struct TTwoVars {
     uint8_t X;
     uint8_t Y;
 
-    static TTwoVars Parse(uint16_t opcode) {
-        return TTwoVars { .X = GetOctetAt<3>(opcode), .Y = GetOctetAt<2>(opcode) };
+    constexpr uint16_t Encode() const {
+        return ((X & 0x0F) << 8) | ((Y & 0x0F) << 4);
     }
 };
 
-enum class EOperationType {
+enum class EOperationType : uint8_t {
+    UNKNOWN,
     CLS,
     RET,
     JUMP,
@@ -91,26 +90,76 @@ enum class EOperationType {
     STORE_BCD_VAR,
 };
 
+constexpr size_t OperationTypesCount = static_cast<size_t>(EOperationType::STORE_BCD_VAR) + 1;
+
+// Decoded instruction: operation type plus every operand field pre-extracted from the word
 class TOpcode {
 public:
-    using TArguments = boost::variant<TEmpty, TAddress, TVar, TVarWithConst, TTwoVars, TTwoVarsWithConst>;
+    constexpr TOpcode()
+        : TOpcode(EOperationType::UNKNOWN, TEmpty {})
+    {}
 
-public:
-    TOpcode(EOperationType opType, const TArguments& arguments)
-            : OperationType(opType)
-            , Arguments(arguments)
+    template <typename TArgs>
+    constexpr TOpcode(EOperationType opType, const TArgs& arguments)
+        : TOpcode(opType, arguments.Encode(), 0)
     {}
 
-    EOperationType GetOperationType() const {
+    static constexpr TOpcode FromWord(EOperationType opType, uint16_t word) {
+        return TOpcode(opType, word, 0);
+    }
+
+    constexpr EOperationType GetOperationType() const {
         return OperationType;
     };
 
     template <typename T>
-    const T& GetArgs() const {
-        return boost::get<T>(Arguments);
-    }
+    T GetArgs() const;
+
+private:
+    constexpr TOpcode(EOperationType opType, uint16_t word, int)
+        : OperationType(opType)
+        , X(GetOctetAt<3>(word))
+        , Y(GetOctetAt<2>(word))
+        , N(GetOctetAt<1>(word))
+        , NN(GetOctetsRange<1, 2>(word))
+        , NNN(GetOctetsRange<1, 3>(word))
+    {}
 
 private:
     EOperationType OperationType;
-    TArguments Arguments;
+    uint8_t X;
+    uint8_t Y;
+    uint8_t N;
+    uint8_t NN;
+    uint16_t NNN;
 };
+
+template <>
+inline TEmpty TOpcode::GetArgs<TEmpty>() const {
+    return TEmpty {};
+}
+
+template <>
+inline TAddress TOpcode::GetArgs<TAddress>() const {
+    return TAddress { .Value = NNN };
+}
+
+template <>
+inline TVar TOpcode::GetArgs<TVar>() const {
+    return TVar { .X = X };
+}
+
+template <>
+inline TVarWithConst TOpcode::GetArgs<TVarWithConst>() const {
+    return TVarWithConst { .X = X, .Const = NN };
+}
+
+template <>
+inline TTwoVars TOpcode::GetArgs<TTwoVars>() const {
+    return TTwoVars { .X = X, .Y = Y };
+}
+
+template <>
+inline TTwoVarsWithConst TOpcode::GetArgs<TTwoVarsWithConst>() const {
+    return TTwoVarsWithConst { .X = X, .Y = Y, .Const = N };
+}
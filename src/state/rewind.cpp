@@ -0,0 +1,123 @@
+#include "rewind.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+const size_t TRewindBuffer::MaxPending;
+
+TRewindBuffer::TRewindBuffer(size_t maxBytes)
+    : MaxBytes(maxBytes)
+    , PendingLimit(std::max<size_t>(1, std::min(MaxPending, maxBytes / sizeof(TSnapshot))))
+{
+    if (maxBytes == 0) {
+        throw std::invalid_argument("Rewind buffer needs a non-zero byte budget");
+    }
+    Worker = std::thread([this]() { WorkerLoop(); });
+}
+
+TRewindBuffer::~TRewindBuffer() {
+    {
+        std::lock_guard<std::mutex> lock(Lock);
+        Stopping = true;
+    }
+    Pushed.notify_one();
+    Worker.join();
+}
+
+void TRewindBuffer::Push(const TSnapshot& snapshot) {
+    std::unique_ptr<TSnapshot> copy;
+    {
+        std::lock_guard<std::mutex> lock(Lock);
+        if (!Spare.empty()) {
+            copy = std::move(Spare.back());
+            Spare.pop_back();
+        }
+    }
+    if (!copy) {
+        copy.reset(new TSnapshot);
+    }
+    *copy = snapshot;
+    {
+        std::unique_lock<std::mutex> lock(Lock);
+        Taken.wait(lock, [this]() { return Pending.size() < PendingLimit; });
+        Pending.push_back(std::move(copy));
+        Trim();
+    }
+    Pushed.notify_one();
+}
+
+bool TRewindBuffer::Rewind(size_t frames, TSnapshot& snapshot) {
+    std::unique_lock<std::mutex> lock(Lock);
+    Flush(lock);
+    if (!Latest) {
+        return false;
+    }
+    for (frames = std::min(frames, Deltas.size()); frames > 0; --frames) {
+        ApplyDelta(Deltas.back(), *Latest);
+        Bytes -= sizeof(Deltas.back()) + Deltas.back().capacity();
+        Deltas.pop_back();
+    }
+    snapshot = *Latest;
+    return true;
+}
+
+size_t TRewindBuffer::GetFramesCount() {
+    std::unique_lock<std::mutex> lock(Lock);
+    Flush(lock);
+    return Latest ? Deltas.size() + 1 : 0;
+}
+
+size_t TRewindBuffer::GetBytes() {
+    std::unique_lock<std::mutex> lock(Lock);
+    Flush(lock);
+    return Bytes;
+}
+
+void TRewindBuffer::Flush(std::unique_lock<std::mutex>& lock) {
+    Drained.wait(lock, [this]() { return Pending.empty() && !Encoding; });
+}
+
+void TRewindBuffer::Trim() {
+    const size_t pendingBytes = Pending.size() * sizeof(TSnapshot);
+    while (Bytes + pendingBytes > MaxBytes && !Deltas.empty()) {
+        Bytes -= sizeof(Deltas.front()) + Deltas.front().capacity();
+        Deltas.pop_front();
+    }
+}
+
+void TRewindBuffer::WorkerLoop() {
+    std::unique_lock<std::mutex> lock(Lock);
+    while (true) {
+        Pushed.wait(lock, [this]() { return Stopping || !Pending.empty(); });
+        if (Pending.empty()) {
+            break;
+        }
+        std::unique_ptr<TSnapshot> next = std::move(Pending.front());
+        Pending.pop_front();
+        Taken.notify_one();
+        Encoding = true;
+        lock.unlock();
+
+        std::vector<uint8_t> delta;
+        const bool first = !Latest;
+        if (!first) {
+            delta = EncodeDelta(*Latest, *next);
+            delta.shrink_to_fit();
+        }
+        Latest.swap(next);
+
+        lock.lock();
+        if (!first) {
+            Bytes += sizeof(delta) + delta.capacity();
+            Deltas.push_back(std::move(delta));
+            Trim();
+        }
+        if (next) {
+            Spare.push_back(std::move(next));
+        }
+        Encoding = false;
+        if (Pending.empty()) {
+            Drained.notify_all();
+        }
+    }
+}
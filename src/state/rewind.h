@@ -0,0 +1,67 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <state/snapshot.h>
+
+// History of per-frame snapshots kept as XOR deltas between neighbours, newest last. Only
+// the newest snapshot is stored whole; older ones are rebuilt by applying deltas backwards
+// from it. Pushing copies the snapshot into a spare buffer and returns: the deltas are
+// encoded by a background thread. When the history outgrows its byte budget the oldest
+// deltas are dropped. Snapshots waiting for the worker count against the budget too, and
+// at most a few of them are queued: when pushes outrun the worker, Push waits for it.
+class TRewindBuffer {
+public:
+    explicit TRewindBuffer(size_t maxBytes);
+    ~TRewindBuffer();
+
+    TRewindBuffer(const TRewindBuffer&) = delete;
+    TRewindBuffer& operator=(const TRewindBuffer&) = delete;
+
+    void Push(const TSnapshot& snapshot);
+
+    // Drops the newest `frames` snapshots (fewer if the history is shorter) and stores the
+    // snapshot that is newest after that in `snapshot`. Returns false if nothing was pushed.
+    // Not to be called concurrently with Push
+    bool Rewind(size_t frames, TSnapshot& snapshot);
+
+    // Snapshots that can be rewound to, the newest included
+    size_t GetFramesCount();
+
+    // Bytes held by the deltas and their bookkeeping, not counting the newest snapshot
+    size_t GetBytes();
+
+    // Snapshots queued for the worker at most, fewer if the byte budget holds less
+    static const size_t MaxPending = 4;
+
+private:
+    void Flush(std::unique_lock<std::mutex>& lock);
+    void Trim();
+    void WorkerLoop();
+
+private:
+    const size_t MaxBytes;
+    const size_t PendingLimit;
+
+    std::mutex Lock;
+    std::condition_variable Pushed;
+    std::condition_variable Taken;
+    std::condition_variable Drained;
+    std::deque<std::unique_ptr<TSnapshot>> Pending;
+    std::vector<std::unique_ptr<TSnapshot>> Spare;
+    std::deque<std::vector<uint8_t>> Deltas;
+    size_t Bytes = 0;
+    bool Encoding = false;
+    bool Stopping = false;
+
+    // Owned by the worker while it encodes, by Rewind otherwise
+    std::unique_ptr<TSnapshot> Latest;
+
+    std::thread Worker;
+};
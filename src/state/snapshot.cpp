@@ -0,0 +1,153 @@
+#include "snapshot.h"
+
+#include <cstring>
+#include <stdexcept>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+    const char SnapshotMagic[8] = {'C', 'H', '8', 'S', 'T', 'A', 'T', 'E'};
+
+    void PutCount(std::vector<uint8_t>& output, size_t count) {
+        do {
+            const uint8_t low = count & 0x7F;
+            count >>= 7;
+            output.push_back(count ? low | 0x80 : low);
+        } while (count);
+    }
+
+    // A differing run only ends at this many equal bytes; shorter gaps cost less as zero literals
+    const size_t MinEqualRun = 4;
+
+    // First position at or after `pos` where the buffers differ, or `size`. Equal stretches
+    // are skipped 16 bytes per compare with SSE2, 8 with plain words elsewhere
+    size_t FindMismatch(const uint8_t* a, const uint8_t* b, size_t pos, size_t size) {
+#if defined(__SSE2__)
+        for (; pos + 16 <= size; pos += 16) {
+            const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + pos));
+            const __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + pos));
+            const unsigned equal = _mm_movemask_epi8(_mm_cmpeq_epi8(x, y));
+            if (equal != 0xFFFF) {
+                return pos + __builtin_ctz(~equal);
+            }
+        }
+#endif
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        for (; pos + 8 <= size; pos += 8) {
+            uint64_t x;
+            uint64_t y;
+            std::memcpy(&x, a + pos, sizeof(x));
+            std::memcpy(&y, b + pos, sizeof(y));
+            if (x != y) {
+                return pos + __builtin_ctzll(x ^ y) / 8;
+            }
+        }
+#endif
+        while (pos < size && a[pos] == b[pos]) {
+            ++pos;
+        }
+        return pos;
+    }
+
+    // End of the differing run starting at `pos`: the start of the next MinEqualRun equal bytes
+    size_t FindMatch(const uint8_t* a, const uint8_t* b, size_t pos, size_t size) {
+        size_t equal = 0;
+        for (; pos < size; ++pos) {
+            if (a[pos] != b[pos]) {
+                equal = 0;
+            } else if (++equal == MinEqualRun) {
+                return pos + 1 - MinEqualRun;
+            }
+        }
+        return size - equal;
+    }
+
+    size_t GetCount(const std::vector<uint8_t>& input, size_t& pos) {
+        size_t count = 0;
+        for (size_t shift = 0;; shift += 7) {
+            const uint8_t byte = input.at(pos++);
+            count |= static_cast<size_t>(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) {
+                return count;
+            }
+        }
+    }
+}
+
+void InitSnapshot(TSnapshot& snapshot) {
+    std::memcpy(snapshot.Magic, SnapshotMagic, sizeof(snapshot.Magic));
+    snapshot.Version = TSnapshot::CurrentVersion;
+    snapshot.Size = sizeof(TSnapshot);
+}
+
+void CheckSnapshot(const TSnapshot& snapshot) {
+    if (std::memcmp(snapshot.Magic, SnapshotMagic, sizeof(SnapshotMagic)) != 0
+        || snapshot.Version != TSnapshot::CurrentVersion
+        || snapshot.Size != sizeof(TSnapshot)
+        || snapshot.StackDepth > TSnapshot::MaxStackDepth
+        || snapshot.KeysCount > TSnapshot::MaxPendingKeys)
+    {
+        throw std::runtime_error("Unsupported save state");
+    }
+}
+
+void WriteSnapshot(std::ostream& output, const TSnapshot& snapshot) {
+    output.write(reinterpret_cast<const char*>(&snapshot), sizeof(snapshot));
+    if (!output) {
+        throw std::runtime_error("Can't write save state");
+    }
+}
+
+TSnapshot ReadSnapshot(std::istream& input) {
+    TSnapshot snapshot;
+    input.read(reinterpret_cast<char*>(&snapshot), sizeof(snapshot));
+    if (input.gcount() != sizeof(snapshot)) {
+        throw std::runtime_error("Truncated save state");
+    }
+    CheckSnapshot(snapshot);
+    return snapshot;
+}
+
+std::vector<uint8_t> EncodeDelta(const TSnapshot& from, const TSnapshot& to) {
+    const auto* a = reinterpret_cast<const uint8_t*>(&from);
+    const auto* b = reinterpret_cast<const uint8_t*>(&to);
+    const size_t size = sizeof(TSnapshot);
+
+    std::vector<uint8_t> delta;
+    size_t pos = 0;
+    while (pos < size) {
+        const size_t equalStart = pos;
+        pos = FindMismatch(a, b, pos, size);
+        if (pos == size) {
+            break;
+        }
+        const size_t diffStart = pos;
+        pos = FindMatch(a, b, pos, size);
+
+        PutCount(delta, diffStart - equalStart);
+        PutCount(delta, pos - diffStart);
+        for (size_t i = diffStart; i < pos; ++i) {
+            delta.push_back(a[i] ^ b[i]);
+        }
+    }
+    return delta;
+}
+
+void ApplyDelta(const std::vector<uint8_t>& delta, TSnapshot& snapshot) {
+    auto* bytes = reinterpret_cast<uint8_t*>(&snapshot);
+    size_t offset = 0;
+    size_t pos = 0;
+    while (pos < delta.size()) {
+        offset += GetCount(delta, pos);
+        const size_t count = GetCount(delta, pos);
+        if (offset + count > sizeof(TSnapshot) || pos + count > delta.size()) {
+            throw std::runtime_error("Corrupt snapshot delta");
+        }
+        for (size_t i = 0; i < count; ++i) {
+            bytes[offset + i] ^= delta[pos + i];
+        }
+        offset += count;
+        pos += count;
+    }
+}
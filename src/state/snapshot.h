@@ -0,0 +1,55 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <type_traits>
+#include <vector>
+#include <io/video.h>
+
+// Complete machine state in one fixed-layout, trivially copyable block: copying a
+// snapshot is a memcpy and the save-state file is these bytes as they are in memory.
+struct TSnapshot {
+    static const uint32_t CurrentVersion = 3;
+    static const size_t MaxStackDepth = 16;
+    static const size_t MaxPendingKeys = 16;
+
+    char Magic[8];
+    uint32_t Version;
+    uint32_t Size;
+
+    uint64_t Cycles;
+    uint16_t PC;
+    uint16_t I;
+    uint8_t DT;
+    uint8_t ST;
+    uint8_t StackDepth;
+    uint8_t KeysCount;
+    std::array<uint8_t, 16> V;
+    std::array<uint8_t, MaxPendingKeys> Keys;       // oldest first
+    std::array<uint16_t, MaxStackDepth> Stack;      // bottom first
+    std::array<uint32_t, 4> Random;                 // RND generator state
+    TVideoMemory VideoMemory;
+    std::array<uint8_t, 0x1000> Memory;
+};
+
+static_assert(std::is_trivially_copyable<TSnapshot>::value, "Snapshots are copied as raw bytes");
+static_assert(sizeof(TSnapshot) == 4464, "Snapshot layout is part of the save-state format");
+
+// Stamps the header; the machine fills in the rest
+void InitSnapshot(TSnapshot& snapshot);
+
+// Throws std::runtime_error unless the header matches this build's format
+void CheckSnapshot(const TSnapshot& snapshot);
+
+void WriteSnapshot(std::ostream& output, const TSnapshot& snapshot);
+TSnapshot ReadSnapshot(std::istream& input);
+
+// Delta between two snapshots: the XOR of their bytes as alternating runs of a LEB128
+// count of equal bytes, a LEB128 count of differing bytes and those XORed bytes. Most of
+// a snapshot doesn't change from one frame to the next, so deltas are small.
+std::vector<uint8_t> EncodeDelta(const TSnapshot& from, const TSnapshot& to);
+
+// XOR is its own inverse: applying the delta turns `from` into `to` and `to` into `from`
+void ApplyDelta(const std::vector<uint8_t>& delta, TSnapshot& snapshot);
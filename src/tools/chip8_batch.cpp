@@ -0,0 +1,200 @@
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <chip8.h>
+#include <io/script.h>
+#include <utils/work_stealing_pool.h>
+
+namespace {
+    struct TOptions {
+        uint64_t Frames = 60 * 60;
+        uint32_t InstructionsPerTick = TChip8Machine::DefaultInstructionsPerTick;
+        // The fastest backend in chip8-bench; without labels-as-values it falls back to a
+        // switch that is no faster than plain dispatch
+#if defined(__GNUC__)
+        TChip8Machine::ECpuBackend Backend = TChip8Machine::ECpuBackend::Threaded;
+#else
+        TChip8Machine::ECpuBackend Backend = TChip8Machine::ECpuBackend::Dispatch;
+#endif
+        size_t Threads = std::thread::hardware_concurrency();
+        uint64_t Seed = 0;      // every job gets the same one, so reruns give the same hashes
+    };
+
+    struct TJob {
+        std::string Rom;
+        std::string Script;     // empty: run without input
+    };
+
+    struct TResult {
+        std::string Exit;
+        uint64_t Cycles = 0;
+        uint64_t FrameHash = 0;
+    };
+
+    // A directory expands to the regular files in it, sorted; anything else is taken as is
+    std::vector<std::string> ListFiles(const std::string& path) {
+        struct stat info;
+        if (stat(path.c_str(), &info) != 0) {
+            throw std::runtime_error("Can't access " + path);
+        }
+        if (!S_ISDIR(info.st_mode)) {
+            return {path};
+        }
+
+        std::vector<std::string> files;
+        DIR* dir = opendir(path.c_str());
+        if (!dir) {
+            throw std::runtime_error("Can't open directory " + path);
+        }
+        while (const dirent* entry = readdir(dir)) {
+            const std::string file = path + "/" + entry->d_name;
+            if (stat(file.c_str(), &info) == 0 && S_ISREG(info.st_mode)) {
+                files.push_back(file);
+            }
+        }
+        closedir(dir);
+
+        std::sort(files.begin(), files.end());
+        return files;
+    }
+
+    // FNV-1a over the rows, so equal screens give equal hashes across runs and hosts
+    uint64_t HashFrame(const TVideoMemory& frame) {
+        uint64_t hash = 0xCBF29CE484222325;
+        for (const uint64_t row : frame) {
+            for (size_t byte = 0; byte < sizeof(row); ++byte) {
+                hash ^= (row >> (8 * byte)) & 0xFF;
+                hash *= 0x100000001B3;
+            }
+        }
+        return hash;
+    }
+
+    const char* ToString(TChip8Machine::EExitReason reason) {
+        switch (reason) {
+            case TChip8Machine::EExitReason::Stopped:
+                return "stopped";
+            case TChip8Machine::EExitReason::TickLimit:
+                return "frames";
+            case TChip8Machine::EExitReason::InputClosed:
+                return "input";
+        }
+        return "unknown";
+    }
+
+    TResult RunJob(const TJob& job, const TOptions& options) {
+        TResult result;
+        try {
+            std::unique_ptr<TChip8Machine> machine(new TChip8Machine);
+            machine->SetCpuBackend(options.Backend);
+            machine->SetInstructionsPerTick(options.InstructionsPerTick);
+            machine->SetSpeed(TChip8Machine::Unthrottled);
+            machine->SetRandomSeed(options.Seed);
+            machine->LoadGame(job.Rom);
+
+            std::unique_ptr<TScriptedInput> input;
+            if (!job.Script.empty()) {
+                std::ifstream script(job.Script);
+                input.reset(new TScriptedInput(ReadInputScript(script)));
+                machine->SetInputSource(input.get());
+            }
+
+            result.Exit = ToString(machine->Execute(options.Frames));
+            result.Cycles = machine->GetCycles();
+            result.FrameHash = HashFrame(machine->GetVideoMemory());
+        } catch (const std::exception& e) {
+            result.Exit = std::string("error: ") + e.what();
+        }
+        return result;
+    }
+
+    std::string QuoteCsv(const std::string& value) {
+        if (value.find_first_of(",\"\n") == std::string::npos) {
+            return value;
+        }
+        std::string quoted = "\"";
+        for (const char c : value) {
+            quoted += c == '"' ? std::string("\"\"") : std::string(1, c);
+        }
+        return quoted + "\"";
+    }
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cerr << "Usage: chip8-batch <rom file or directory> [--inputs=<script file or directory>] "
+                     "[--frames=N] [--instructions-per-tick=N] [--threads=N] [--seed=N] [--dispatch|--threaded|--blocks]\n";
+        return 1;
+    }
+
+    TOptions options;
+    std::string romsPath;
+    std::string scriptsPath;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        const auto eq = arg.find('=');
+        const std::string name = arg.substr(0, eq);
+        const std::string value = eq == std::string::npos ? "" : arg.substr(eq + 1);
+
+        if (name == "--inputs") {
+            scriptsPath = value;
+        } else if (name == "--frames") {
+            options.Frames = std::stoull(value);
+        } else if (name == "--instructions-per-tick") {
+            options.InstructionsPerTick = std::stoul(value);
+        } else if (name == "--threads") {
+            options.Threads = std::stoul(value);
+        } else if (name == "--seed") {
+            options.Seed = std::stoull(value);
+        } else if (name == "--dispatch") {
+            options.Backend = TChip8Machine::ECpuBackend::Dispatch;
+        } else if (name == "--threaded") {
+            options.Backend = TChip8Machine::ECpuBackend::Threaded;
+        } else if (name == "--blocks") {
+            options.Backend = TChip8Machine::ECpuBackend::Blocks;
+        } else {
+            romsPath = arg;
+        }
+    }
+
+    // Every ROM runs once per input script, or once without input if there are none
+    std::vector<TJob> jobs;
+    try {
+        const auto scripts = scriptsPath.empty() ? std::vector<std::string> {""} : ListFiles(scriptsPath);
+        for (const auto& rom : ListFiles(romsPath)) {
+            for (const auto& script : scripts) {
+                jobs.push_back({rom, script});
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+
+    std::vector<TResult> results(jobs.size());
+    {
+        TWorkStealingPool pool(options.Threads);
+        for (size_t i = 0; i < jobs.size(); ++i) {
+            pool.Submit([&jobs, &results, &options, i]() {
+                results[i] = RunJob(jobs[i], options);
+            });
+        }
+        pool.Wait();
+    }
+
+    std::cout << "rom,script,exit,cycles,frame_hash\n";
+    for (size_t i = 0; i < jobs.size(); ++i) {
+        std::cout << QuoteCsv(jobs[i].Rom) << ',' << QuoteCsv(jobs[i].Script) << ','
+                  << QuoteCsv(results[i].Exit) << ',' << results[i].Cycles << ','
+                  << std::hex << std::setw(16) << std::setfill('0') << results[i].FrameHash
+                  << std::dec << '\n';
+    }
+    return 0;
+}
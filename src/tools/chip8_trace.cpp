@@ -0,0 +1,93 @@
+#include <iostream>
+#include <string>
+#include <limits>
+
+#include <opcode/disasm.h>
+#include <opcode/parser.h>
+#include <trace/trace.h>
+
+namespace {
+    struct TFilter {
+        uint64_t FromCycle = 0;
+        uint64_t ToCycle = std::numeric_limits<uint64_t>::max();
+        uint16_t FromPC = 0;
+        uint16_t ToPC = 0xFFFF;
+        std::string Mnemonic;
+        int Register = -1;
+
+        bool Matches(const TTraceRecord& record) const {
+            if (record.Cycle < FromCycle || record.Cycle > ToCycle) {
+                return false;
+            }
+            if (record.PC < FromPC || record.PC > ToPC) {
+                return false;
+            }
+            if (Register >= 0 && record.Register != Register) {
+                return false;
+            }
+            if (!Mnemonic.empty()) {
+                const auto text = Disassemble(TOpcodeParser::Parse(record.Word));
+                if (text.compare(0, Mnemonic.size(), Mnemonic) != 0) {
+                    return false;
+                }
+            }
+            return true;
+        }
+    };
+
+    template <typename T>
+    void ParseRange(const std::string& value, int base, T& from, T& to) {
+        const auto dash = value.find('-');
+        from = static_cast<T>(std::stoull(value.substr(0, dash), nullptr, base));
+        to = dash == std::string::npos ? from : static_cast<T>(std::stoull(value.substr(dash + 1), nullptr, base));
+    }
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cerr << "Usage: chip8-trace <trace file> [--cycles=FROM-TO] [--pc=HEX-HEX] [--op=MNEMONIC] [--reg=X] [--tail=N]\n";
+        return 1;
+    }
+
+    std::string tracePath;
+    TFilter filter;
+    size_t tail = 0;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        const auto eq = arg.find('=');
+        const std::string name = arg.substr(0, eq);
+        const std::string value = eq == std::string::npos ? "" : arg.substr(eq + 1);
+
+        if (name == "--cycles") {
+            ParseRange(value, 10, filter.FromCycle, filter.ToCycle);
+        } else if (name == "--pc") {
+            ParseRange(value, 16, filter.FromPC, filter.ToPC);
+        } else if (name == "--op") {
+            filter.Mnemonic = value;
+        } else if (name == "--reg") {
+            filter.Register = std::stoi(value, nullptr, 16);
+        } else if (name == "--tail") {
+            tail = std::stoull(value);
+        } else {
+            tracePath = arg;
+        }
+    }
+
+    const TTraceFileReader trace(tracePath);
+
+    // With --tail only the last N matching records are printed, so scan from the end
+    size_t first = 0;
+    if (tail > 0) {
+        size_t found = 0;
+        for (first = trace.Size(); first > 0 && found < tail; --first) {
+            found += filter.Matches(trace[first - 1]) ? 1 : 0;
+        }
+    }
+
+    for (size_t i = first; i < trace.Size(); ++i) {
+        if (filter.Matches(trace[i])) {
+            std::cout << FormatTraceRecord(trace[i]) << '\n';
+        }
+    }
+    return 0;
+}
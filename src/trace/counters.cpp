@@ -0,0 +1,48 @@
+#include "counters.h"
+
+#include <iomanip>
+
+#include <opcode/disasm.h>
+
+namespace {
+    std::ostream& Address(std::ostream& output, size_t pc) {
+        return output << std::hex << std::uppercase << std::setw(3) << std::setfill('0') << pc
+                      << std::dec << std::nouppercase << std::setfill(' ');
+    }
+}
+
+void TExecutionCounters::WriteCsv(std::ostream& output) const {
+    output << "kind,key,count\n";
+    for (size_t type = 0; type < Operations.size(); ++type) {
+        if (Operations[type] != 0) {
+            output << "operation," << GetOperationName(static_cast<EOperationType>(type)) << ','
+                   << Operations[type] << '\n';
+        }
+    }
+    for (size_t pc = 0; pc < Addresses.size(); ++pc) {
+        if (Addresses[pc] != 0) {
+            Address(output << "pc,", pc) << ',' << Addresses[pc] << '\n';
+        }
+    }
+}
+
+void TExecutionCounters::WriteJson(std::ostream& output) const {
+    output << "{\"operations\": {";
+    const char* separator = "";
+    for (size_t type = 0; type < Operations.size(); ++type) {
+        if (Operations[type] != 0) {
+            output << separator << '"' << GetOperationName(static_cast<EOperationType>(type)) << "\": "
+                   << Operations[type];
+            separator = ", ";
+        }
+    }
+    output << "}, \"pcs\": {";
+    separator = "";
+    for (size_t pc = 0; pc < Addresses.size(); ++pc) {
+        if (Addresses[pc] != 0) {
+            Address(output << separator << '"', pc) << "\": " << Addresses[pc];
+            separator = ", ";
+        }
+    }
+    output << "}}\n";
+}
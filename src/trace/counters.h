@@ -0,0 +1,25 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <ostream>
+
+#include <opcode/types.h>
+
+// Executions per operation type and per address. Plain counters bumped by the CPU thread
+// without synchronization: read them from that thread or once the machine has stopped.
+struct TExecutionCounters {
+    std::array<uint64_t, OperationTypesCount> Operations {};
+    std::array<uint64_t, 0x1000> Addresses {};
+
+    void Count(EOperationType type, uint16_t pc) {
+        ++Operations[static_cast<size_t>(type)];
+        ++Addresses[pc & 0xFFF];
+    }
+
+    // Rows of "operation,<name>,<count>" and "pc,<hex address>,<count>", zeros left out
+    void WriteCsv(std::ostream& output) const;
+
+    // {"operations": {"<name>": count, ...}, "pcs": {"<hex address>": count, ...}}, zeros left out
+    void WriteJson(std::ostream& output) const;
+};
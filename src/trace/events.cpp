@@ -0,0 +1,117 @@
+#include "events.h"
+
+#include <atomic>
+#include <iomanip>
+
+const size_t TEventTracer::MaxEventsPerThread;
+
+namespace {
+    // Ids rather than addresses, so a tracer allocated where an old one was isn't mistaken for it
+    std::atomic<uint64_t> NextTracerId {1};
+
+    struct TCurrentThread {
+        uint64_t Tracer = 0;
+        void* Buffer = nullptr;
+    };
+
+    TCurrentThread& CurrentThreadCache() {
+        static thread_local TCurrentThread current;
+        return current;
+    }
+
+    void WriteJsonString(std::ostream& output, const std::string& value) {
+        output << '"';
+        for (const char c : value) {
+            if (c == '"' || c == '\\') {
+                output << '\\' << c;
+            } else if (static_cast<unsigned char>(c) < 0x20) {
+                output << ' ';
+            } else {
+                output << c;
+            }
+        }
+        output << '"';
+    }
+
+    void WriteMicroseconds(std::ostream& output, int64_t ns) {
+        output << ns / 1000 << '.' << std::setw(3) << std::setfill('0') << ns % 1000 << std::setfill(' ');
+    }
+}
+
+TEventTracer::TEventTracer()
+    : Id(NextTracerId++)
+    , Origin(std::chrono::steady_clock::now())
+{}
+
+void TEventTracer::SetThreadName(const std::string& name) {
+    auto& thread = CurrentThread();
+    std::lock_guard<std::mutex> lock(Lock);
+    thread.Name = name;
+}
+
+void TEventTracer::Complete(const char* name, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end) {
+    Push({name, Since(start), Since(end) - Since(start)});
+}
+
+void TEventTracer::Instant(const char* name) {
+    Push({name, Since(std::chrono::steady_clock::now()), -1});
+}
+
+void TEventTracer::Write(std::ostream& output) const {
+    std::lock_guard<std::mutex> lock(Lock);
+    output << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+    const char* separator = "";
+    for (const auto& thread : Threads) {
+        output << separator << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << thread->Id
+               << ", \"args\": {\"name\": ";
+        WriteJsonString(output, thread->Name);
+        output << "}}";
+        separator = ",\n";
+
+        for (const auto& event : thread->Events) {
+            output << separator << "{\"name\": ";
+            WriteJsonString(output, event.Name);
+            output << ", \"pid\": 1, \"tid\": " << thread->Id << ", \"ts\": ";
+            WriteMicroseconds(output, event.Start);
+            if (event.Duration >= 0) {
+                output << ", \"ph\": \"X\", \"dur\": ";
+                WriteMicroseconds(output, event.Duration);
+            } else {
+                output << ", \"ph\": \"i\", \"s\": \"t\"";
+            }
+            output << '}';
+        }
+
+        if (thread->Dropped > 0) {
+            output << separator << "{\"name\": \"dropped events\", \"ph\": \"C\", \"pid\": 1, \"tid\": " << thread->Id
+                   << ", \"ts\": 0, \"args\": {\"dropped\": " << thread->Dropped << "}}";
+        }
+    }
+    output << "\n]}\n";
+}
+
+TEventTracer::TThreadBuffer& TEventTracer::CurrentThread() {
+    auto& current = CurrentThreadCache();
+    if (current.Tracer != Id) {
+        std::lock_guard<std::mutex> lock(Lock);
+        Threads.emplace_back(new TThreadBuffer);
+        Threads.back()->Id = Threads.size();
+        Threads.back()->Name = "thread " + std::to_string(Threads.size());
+        current.Tracer = Id;
+        current.Buffer = Threads.back().get();
+    }
+    return *static_cast<TThreadBuffer*>(current.Buffer);
+}
+
+void TEventTracer::Push(const TEvent& event) {
+    auto& thread = CurrentThread();
+    if (thread.Events.size() < MaxEventsPerThread) {
+        thread.Events.push_back(event);
+    } else {
+        ++thread.Dropped;
+    }
+}
+
+int64_t TEventTracer::Since(std::chrono::steady_clock::time_point time) const {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(time - Origin).count();
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Timeline of what each thread was doing, written as Chrome trace-event JSON (chrome://tracing,
+// Perfetto). Every thread records into its own buffer without locks; buffers are only read by
+// Write, which has to run after the recording threads are done. Event names must be string
+// literals, as only the pointer is kept.
+class TEventTracer {
+public:
+    // Per thread; later events are counted and dropped
+    static const size_t MaxEventsPerThread = 1 << 20;
+
+    TEventTracer();
+
+    TEventTracer(const TEventTracer&) = delete;
+    TEventTracer& operator=(const TEventTracer&) = delete;
+
+    // Names the calling thread's track
+    void SetThreadName(const std::string& name);
+
+    void Complete(const char* name, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end);
+    void Instant(const char* name);
+
+    void Write(std::ostream& output) const;
+
+private:
+    struct TEvent {
+        const char* Name;
+        int64_t Start;      // ns since the tracer was created
+        int64_t Duration;   // ns; negative for an instant event
+    };
+
+    struct TThreadBuffer {
+        size_t Id;
+        std::string Name;
+        std::deque<TEvent> Events;
+        uint64_t Dropped = 0;
+    };
+
+    const uint64_t Id;
+    const std::chrono::steady_clock::time_point Origin;
+    mutable std::mutex Lock;
+    std::vector<std::unique_ptr<TThreadBuffer>> Threads;
+
+private:
+    TThreadBuffer& CurrentThread();
+    void Push(const TEvent& event);
+    int64_t Since(std::chrono::steady_clock::time_point time) const;
+};
+
+// Records the lifetime of the scope as one span; does nothing without a tracer
+class TEventScope {
+public:
+    TEventScope(TEventTracer* tracer, const char* name)
+        : Tracer(tracer)
+        , Name(name)
+    {
+        if (Tracer) {
+            Start = std::chrono::steady_clock::now();
+        }
+    }
+
+    ~TEventScope() {
+        if (Tracer) {
+            Tracer->Complete(Name, Start, std::chrono::steady_clock::now());
+        }
+    }
+
+    TEventScope(const TEventScope&) = delete;
+    TEventScope& operator=(const TEventScope&) = delete;
+
+private:
+    TEventTracer* Tracer;
+    const char* Name;
+    std::chrono::steady_clock::time_point Start;
+};
+
+// Locks `mutex`, recording a span named `name` only if the lock was contended
+template <typename TMutex>
+std::unique_lock<TMutex> LockTraced(TEventTracer* tracer, TMutex& mutex, const char* name) {
+    std::unique_lock<TMutex> lock(mutex, std::try_to_lock);
+    if (!lock.owns_lock()) {
+        TEventScope wait(tracer, name);
+        lock.lock();
+    }
+    return lock;
+}
@@ -0,0 +1,150 @@
+#include "file.h"
+
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+    const char TraceMagic[8] = {'C', 'H', '8', 'T', 'R', 'A', 'C', 'E'};
+
+    // Multiple of the page size and of the record size, so records never straddle chunks
+    const size_t ChunkSize = 16 << 20;
+
+    std::runtime_error SystemError(const std::string& what, const std::string& path) {
+        return std::runtime_error(what + " " + path + ": " + std::strerror(errno));
+    }
+}
+
+const uint8_t TTraceRecord::NoRegister;
+const uint32_t TTraceFileHeader::CurrentVersion;
+
+TTraceFileWriter::TTraceFileWriter(const std::string& path)
+    : Path(path)
+    , Failed(false)
+    , Fd(::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644))
+    , ChunkOffset(0)
+    , Chunk(nullptr)
+    , Next(nullptr)
+    , End(nullptr)
+    , Count(0)
+{
+    if (Fd < 0) {
+        throw SystemError("Can't open trace file", path);
+    }
+
+    MapNextChunk();
+
+    TTraceFileHeader header;
+    std::memcpy(header.Magic, TraceMagic, sizeof(header.Magic));
+    header.Version = TTraceFileHeader::CurrentVersion;
+    header.RecordSize = sizeof(TTraceRecord);
+    std::memcpy(Chunk, &header, sizeof(header));
+    Next = reinterpret_cast<TTraceRecord*>(static_cast<char*>(Chunk) + sizeof(header));
+}
+
+TTraceFileWriter::~TTraceFileWriter() {
+    Unmap();
+    if (::ftruncate(Fd, sizeof(TTraceFileHeader) + Count * sizeof(TTraceRecord)) != 0) {
+        // Nothing sensible to do in a destructor; the reader skips the zeroed tail
+    }
+    ::close(Fd);
+}
+
+bool TTraceFileWriter::Grow() noexcept {
+    if (Failed) {
+        return false;
+    }
+
+    try {
+        MapNextChunk();
+        return true;
+    } catch (const std::exception& e) {
+        // Keeps the records written so far: the destructor trims the file to them
+        Failed = true;
+        Next = End = nullptr;
+        std::cerr << e.what() << ", trace file " << Path << " stops after " << Count << " records\n";
+        return false;
+    }
+}
+
+void TTraceFileWriter::MapNextChunk() {
+    if (Chunk) {
+        ChunkOffset += ChunkSize;
+        Unmap();
+    }
+
+    if (::ftruncate(Fd, ChunkOffset + ChunkSize) != 0) {
+        throw std::runtime_error(std::string("Can't grow trace file: ") + std::strerror(errno));
+    }
+
+    Chunk = ::mmap(nullptr, ChunkSize, PROT_READ | PROT_WRITE, MAP_SHARED, Fd, ChunkOffset);
+    if (Chunk == MAP_FAILED) {
+        Chunk = nullptr;
+        throw std::runtime_error(std::string("Can't map trace file: ") + std::strerror(errno));
+    }
+
+    Next = static_cast<TTraceRecord*>(Chunk);
+    End = Next + ChunkSize / sizeof(TTraceRecord);
+}
+
+void TTraceFileWriter::Unmap() {
+    if (Chunk) {
+        ::munmap(Chunk, ChunkSize);
+        Chunk = nullptr;
+    }
+}
+
+TTraceFileReader::TTraceFileReader(const std::string& path)
+    : Data(nullptr)
+    , DataSize(0)
+    , Records(nullptr)
+    , Count(0)
+{
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw SystemError("Can't open trace file", path);
+    }
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(TTraceFileHeader)) {
+        ::close(fd);
+        throw std::runtime_error("Not a trace file: " + path);
+    }
+
+    DataSize = st.st_size;
+    Data = ::mmap(nullptr, DataSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (Data == MAP_FAILED) {
+        Data = nullptr;
+        throw SystemError("Can't map trace file", path);
+    }
+
+    TTraceFileHeader header;
+    std::memcpy(&header, Data, sizeof(header));
+    if (std::memcmp(header.Magic, TraceMagic, sizeof(TraceMagic)) != 0
+        || header.Version != TTraceFileHeader::CurrentVersion
+        || header.RecordSize != sizeof(TTraceRecord))
+    {
+        ::munmap(Data, DataSize);
+        throw std::runtime_error("Unsupported trace file: " + path);
+    }
+
+    Records = reinterpret_cast<const TTraceRecord*>(static_cast<const char*>(Data) + sizeof(header));
+    Count = (DataSize - sizeof(header)) / sizeof(TTraceRecord);
+
+    // A writer that didn't shut down cleanly leaves the unused part of its last chunk zeroed
+    const TTraceRecord empty = {};
+    while (Count > 0 && std::memcmp(&Records[Count - 1], &empty, sizeof(empty)) == 0) {
+        --Count;
+    }
+}
+
+TTraceFileReader::~TTraceFileReader() {
+    if (Data) {
+        ::munmap(Data, DataSize);
+    }
+}
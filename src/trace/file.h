@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Fixed-size record of one executed instruction; the binary trace file is a header
+// followed by an array of these.
+struct TTraceRecord {
+    static const uint8_t NoRegister = 0xFF;
+
+    uint64_t Cycle;
+    uint16_t PC;
+    uint16_t Word;
+    uint16_t I;         // value of I after the instruction
+    uint8_t Register;   // lowest V register the instruction changed, NoRegister if none
+    uint8_t Value;      // new value of that register
+};
+
+static_assert(sizeof(TTraceRecord) == 16, "Trace record layout is part of the file format");
+
+struct TTraceFileHeader {
+    static const uint32_t CurrentVersion = 1;
+
+    char Magic[8];
+    uint32_t Version;
+    uint32_t RecordSize;
+};
+
+static_assert(sizeof(TTraceFileHeader) == 16, "Trace header layout is part of the file format");
+
+// Appends records to a memory-mapped file, growing it a chunk at a time; the hot path
+// is a bounds check and a 16-byte store. Push runs from destructors and never throws: if
+// the file can't grow, the error is logged and later records are dropped.
+class TTraceFileWriter {
+public:
+    explicit TTraceFileWriter(const std::string& path);
+    ~TTraceFileWriter();
+
+    TTraceFileWriter(const TTraceFileWriter&) = delete;
+    TTraceFileWriter& operator=(const TTraceFileWriter&) = delete;
+
+    void Push(const TTraceRecord& record) noexcept {
+        if (Next == End && !Grow()) {
+            return;
+        }
+        *Next++ = record;
+        ++Count;
+    }
+
+    uint64_t GetCount() const {
+        return Count;
+    }
+
+private:
+    bool Grow() noexcept;
+    void MapNextChunk();
+    void Unmap();
+
+private:
+    std::string Path;
+    bool Failed;
+    int Fd;
+    size_t ChunkOffset;
+    void* Chunk;
+    TTraceRecord* Next;
+    TTraceRecord* End;
+    uint64_t Count;
+};
+
+class TTraceFileReader {
+public:
+    explicit TTraceFileReader(const std::string& path);
+    ~TTraceFileReader();
+
+    TTraceFileReader(const TTraceFileReader&) = delete;
+    TTraceFileReader& operator=(const TTraceFileReader&) = delete;
+
+    size_t Size() const {
+        return Count;
+    }
+
+    const TTraceRecord& operator[](size_t index) const {
+        return Records[index];
+    }
+
+private:
+    void* Data;
+    size_t DataSize;
+    const TTraceRecord* Records;
+    size_t Count;
+};
@@ -0,0 +1,60 @@
+#include "sampler.h"
+
+#include <iomanip>
+#include <stdexcept>
+
+#include <opcode/disasm.h>
+
+constexpr std::chrono::microseconds TSamplingProfiler::DefaultInterval;
+
+TSamplingProfiler::TSamplingProfiler(std::chrono::microseconds interval) {
+    if (interval.count() <= 0) {
+        throw std::invalid_argument("Sampling interval must be positive");
+    }
+    Timer = std::thread([this, interval]() { TimerLoop(interval); });
+}
+
+TSamplingProfiler::~TSamplingProfiler() {
+    {
+        std::lock_guard<std::mutex> lock(Lock);
+        Stopping = true;
+    }
+    Stopped.notify_one();
+    Timer.join();
+}
+
+void TSamplingProfiler::WriteFolded(std::ostream& output) const {
+    for (const auto& sample : Samples) {
+        output << "main";
+        const auto& key = sample.first;
+        for (size_t i = 0; i + 1 < key.size(); ++i) {
+            output << ";sub_" << std::hex << std::uppercase << std::setw(3) << std::setfill('0') << key[i]
+                   << std::dec << std::nouppercase << std::setfill(' ');
+        }
+        output << ';' << GetOperationName(static_cast<EOperationType>(key.back())) << ' ' << sample.second << '\n';
+    }
+}
+
+void TSamplingProfiler::Record(const uint16_t* returns, size_t depth, const uint8_t* memory, size_t memorySize) {
+    std::vector<uint16_t> key(depth + 1);
+    key.back() = static_cast<uint16_t>(Running);
+
+    // The stack holds return addresses; the CALL just before each one names the subroutine
+    for (size_t i = 0; i < depth; ++i) {
+        const uint16_t call = returns[i] - 2;
+        const uint16_t word = call + 1u < memorySize ? (memory[call] << 8) | memory[call + 1] : 0;
+        key[i] = (word & 0xF000) == 0x2000 ? word & 0x0FFF : call;
+    }
+
+    ++Samples[key];
+    ++SamplesCount;
+}
+
+void TSamplingProfiler::TimerLoop(std::chrono::microseconds interval) {
+    std::unique_lock<std::mutex> lock(Lock);
+    auto next = std::chrono::steady_clock::now() + interval;
+    while (!Stopped.wait_until(lock, next, [this]() { return Stopping; })) {
+        Due.store(true, std::memory_order_relaxed);
+        next = std::chrono::steady_clock::now() + interval;
+    }
+}
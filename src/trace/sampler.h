@@ -0,0 +1,69 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <vector>
+
+#include <opcode/types.h>
+
+// Statistical profile of where host time goes, by emulated call stack. A thread raises a
+// flag every interval; the CPU notices it at the start of the next instruction and charges
+// the sample to the instruction that was running when the flag went up, under the
+// subroutines on the CHIP-8 stack. Samples therefore skid by at most one instruction
+// boundary, and all bookkeeping happens on the CPU thread.
+class TSamplingProfiler {
+public:
+    static constexpr std::chrono::microseconds DefaultInterval {1000};
+
+    explicit TSamplingProfiler(std::chrono::microseconds interval = DefaultInterval);
+    ~TSamplingProfiler();
+
+    TSamplingProfiler(const TSamplingProfiler&) = delete;
+    TSamplingProfiler& operator=(const TSamplingProfiler&) = delete;
+
+    // Called by the CPU before every instruction; `returns` is the call stack, bottom first
+    void Poll(EOperationType type, const uint16_t* returns, size_t depth, const uint8_t* memory, size_t memorySize) {
+        if (Due.load(std::memory_order_relaxed)) {
+            Due.store(false, std::memory_order_relaxed);
+            Record(returns, depth, memory, memorySize);
+        }
+        Running = type;
+    }
+
+    // Drops a sample that fell into time the CPU spent waiting rather than emulating
+    void Discard() {
+        Due.store(false, std::memory_order_relaxed);
+    }
+
+    uint64_t GetSamplesCount() const {
+        return SamplesCount;
+    }
+
+    // Folded stacks, one "main;sub_2A0;DRAW <samples>" line per distinct stack, as read by
+    // flamegraph.pl, speedscope and similar tools. Call once the machine has stopped
+    void WriteFolded(std::ostream& output) const;
+
+private:
+    void Record(const uint16_t* returns, size_t depth, const uint8_t* memory, size_t memorySize);
+    void TimerLoop(std::chrono::microseconds interval);
+
+private:
+    std::atomic<bool> Due {false};
+    EOperationType Running = EOperationType::UNKNOWN;
+
+    // Subroutine entry addresses outermost first, then the operation type
+    std::map<std::vector<uint16_t>, uint64_t> Samples;
+    uint64_t SamplesCount = 0;
+
+    std::mutex Lock;
+    std::condition_variable Stopped;
+    bool Stopping = false;
+    std::thread Timer;
+};
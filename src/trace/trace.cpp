@@ -0,0 +1,61 @@
+#include "trace.h"
+
+#include <algorithm>
+#include <ios>
+#include <iomanip>
+#include <sstream>
+#include <opcode/disasm.h>
+#include <opcode/parser.h>
+
+TTraceBuffer::TTraceBuffer(size_t capacity)
+    : Head(0)
+{
+    size_t size = 1;
+    while (size <= capacity) {
+        size <<= 1;
+    }
+    Records.resize(size);
+    Mask = size - 1;
+}
+
+std::vector<TTraceRecord> TTraceBuffer::Snapshot() const {
+    const uint64_t head = Head.load(std::memory_order_acquire);
+    const uint64_t count = std::min<uint64_t>(head, Records.size());
+
+    std::vector<TTraceRecord> result;
+    result.reserve(count);
+    for (uint64_t i = head - count; i < head; ++i) {
+        result.push_back(Records[i & Mask]);
+    }
+
+    // Records the writer has lapped while we were copying are not consistent, drop them.
+    // That includes the slot of record `after`, which the writer may be filling right now
+    std::atomic_thread_fence(std::memory_order_acquire);
+    const uint64_t after = Head.load(std::memory_order_relaxed);
+    const uint64_t oldestValid = after + 1 > Records.size() ? after + 1 - Records.size() : 0;
+    const uint64_t first = head - count;
+    if (oldestValid > first) {
+        const uint64_t stale = std::min<uint64_t>(oldestValid - first, result.size());
+        result.erase(result.begin(), result.begin() + stale);
+    }
+    return result;
+}
+
+void TTraceBuffer::Dump(std::ostream& out) const {
+    for (const auto& record : Snapshot()) {
+        out << FormatTraceRecord(record) << '\n';
+    }
+}
+
+std::string FormatTraceRecord(const TTraceRecord& record) {
+    std::stringstream ss;
+    ss << std::setw(10) << record.Cycle << "  "
+       << std::hex << std::uppercase << std::setfill('0')
+       << std::setw(3) << record.PC << ": " << std::setw(4) << record.Word << "  "
+       << std::left << std::setfill(' ') << std::setw(20) << Disassemble(TOpcodeParser::Parse(record.Word))
+       << std::right << std::setfill('0') << "I=" << std::setw(3) << record.I;
+    if (record.Register != TTraceRecord::NoRegister) {
+        ss << " V" << static_cast<int>(record.Register) << '=' << std::setw(2) << static_cast<int>(record.Value);
+    }
+    return ss.str();
+}
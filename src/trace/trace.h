@@ -0,0 +1,111 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <ostream>
+#include <vector>
+
+#include <trace/file.h>
+
+// Compile-time trace level:
+//   0 - the trace ring is compiled out (release builds); a TTraceFileWriter attached at
+//       runtime still records
+//   1 - executed instructions go to a TTraceBuffer and/or a TTraceFileWriter,
+//       when one is attached at runtime
+// Either way handlers hold no tracing code: the CPU switches to a hooked loop that wraps
+// each instruction in CHIP8_TRACE only while a trace, counters or the sampler are on.
+#ifndef CHIP8_TRACE_LEVEL
+#define CHIP8_TRACE_LEVEL 1
+#endif
+
+// Ring of the most recent trace records. A single writer pushes without locks;
+// readers may take a snapshot from any thread at any time. The ring is a power of two
+// larger than capacity: the slot the writer fills next is never part of a snapshot.
+class TTraceBuffer {
+public:
+    explicit TTraceBuffer(size_t capacity);
+
+    void Push(const TTraceRecord& record) {
+        const uint64_t head = Head.load(std::memory_order_relaxed);
+        Records[head & Mask] = record;
+        Head.store(head + 1, std::memory_order_release);
+    }
+
+    uint64_t GetTotalCount() const {
+        return Head.load(std::memory_order_acquire);
+    }
+
+    std::vector<TTraceRecord> Snapshot() const;
+    void Dump(std::ostream& out) const;
+
+private:
+    std::vector<TTraceRecord> Records;
+    size_t Mask;
+    std::atomic<uint64_t> Head;
+};
+
+// Captures registers when a handler starts and emits the finished record when it returns,
+// so the record carries the register the instruction changed and the resulting I.
+class TTraceScope {
+public:
+    using TRegisters = std::array<uint8_t, 16>;
+
+    TTraceScope(TTraceBuffer* buffer, TTraceFileWriter* file, uint64_t cycle, uint16_t pc,
+                const uint8_t* memory, size_t memorySize, const TRegisters& registers, const uint16_t& i)
+        : Buffer(buffer)
+        , File(file)
+        , Registers(registers)
+        , I(i)
+    {
+        if (!Buffer && !File) {
+            return;
+        }
+
+        Record.Cycle = cycle;
+        Record.PC = pc;
+        Record.Word = pc + 1u < memorySize ? (memory[pc] << 8) | memory[pc + 1] : 0;
+        Before = registers;
+    }
+
+    ~TTraceScope() {
+        if (!Buffer && !File) {
+            return;
+        }
+
+        Record.I = I;
+        Record.Register = TTraceRecord::NoRegister;
+        Record.Value = 0;
+        for (size_t x = 0; x < Registers.size(); ++x) {
+            if (Registers[x] != Before[x]) {
+                Record.Register = static_cast<uint8_t>(x);
+                Record.Value = Registers[x];
+                break;
+            }
+        }
+
+        if (Buffer) {
+            Buffer->Push(Record);
+        }
+        if (File) {
+            File->Push(Record);
+        }
+    }
+
+private:
+    TTraceBuffer* Buffer;
+    TTraceFileWriter* File;
+    const TRegisters& Registers;
+    const uint16_t& I;
+    TRegisters Before;
+    TTraceRecord Record;
+};
+
+std::string FormatTraceRecord(const TTraceRecord& record);
+
+#if CHIP8_TRACE_LEVEL > 0
+#define CHIP8_TRACE(buffer, file, cycle, pc, memory, registers, i) \
+    TTraceScope traceScope(buffer, file, cycle, pc, (memory).data(), (memory).size(), registers, i)
+#else
+#define CHIP8_TRACE(buffer, file, cycle, pc, memory, registers, i) \
+    TTraceScope traceScope(nullptr, file, cycle, pc, (memory).data(), (memory).size(), registers, i)
+#endif
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+
+// Stack of at most Capacity values held inline, with the std::stack operations the machine
+// uses. Trivially copyable and never allocates; Entries[0] is the bottom, SP the count.
+template <typename T, size_t Capacity>
+struct TFixedStack {
+    static_assert(Capacity > 0 && Capacity <= 0xFF, "SP is a byte");
+
+    std::array<T, Capacity> Entries;
+    uint8_t SP = 0;
+
+    bool empty() const {
+        return SP == 0;
+    }
+
+    size_t size() const {
+        return SP;
+    }
+
+    bool full() const {
+        return SP == Capacity;
+    }
+
+    // Throws std::overflow_error when full
+    void push(const T& value) {
+        if (full()) {
+            throw std::overflow_error("Stack overflow");
+        }
+        Entries[SP++] = value;
+    }
+
+    // Throws std::underflow_error when empty
+    void pop() {
+        if (empty()) {
+            throw std::underflow_error("Stack underflow");
+        }
+        --SP;
+    }
+
+    const T& top() const {
+        if (empty()) {
+            throw std::underflow_error("Stack underflow");
+        }
+        return Entries[SP - 1];
+    }
+
+    const T* data() const {
+        return Entries.data();
+    }
+};
+
+// FIFO of at most Capacity values held inline, with the std::queue operations the machine
+// uses. Pushing to a full queue drops the oldest value, as a keyboard buffer would.
+template <typename T, size_t Capacity>
+struct TFixedQueue {
+    static_assert(Capacity > 0 && Capacity <= 0x80 && (Capacity & (Capacity - 1)) == 0,
+                  "Capacity must be a power of two that a byte can count");
+
+    std::array<T, Capacity> Entries;
+    uint8_t Head = 0;
+    uint8_t Count = 0;
+
+    bool empty() const {
+        return Count == 0;
+    }
+
+    size_t size() const {
+        return Count;
+    }
+
+    void push(const T& value) {
+        if (Count == Capacity) {
+            pop();
+        }
+        Entries[(Head + Count++) & (Capacity - 1)] = value;
+    }
+
+    // Throws std::underflow_error when empty
+    void pop() {
+        if (empty()) {
+            throw std::underflow_error("Queue underflow");
+        }
+        Head = (Head + 1) & (Capacity - 1);
+        --Count;
+    }
+
+    const T& front() const {
+        if (empty()) {
+            throw std::underflow_error("Queue underflow");
+        }
+        return Entries[Head];
+    }
+
+    // Oldest first
+    const T& operator[](size_t index) const {
+        return Entries[(Head + index) & (Capacity - 1)];
+    }
+};
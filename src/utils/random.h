@@ -0,0 +1,40 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+// xoshiro128** by Blackman and Vigna: 16 bytes of plain state and a few shifts and
+// rotations per number, so it can live in the machine state and be snapshotted as is.
+struct TXoshiro128 {
+    std::array<uint32_t, 4> S;
+
+    // Spreads the seed over the state with SplitMix64, which never yields the all-zero state
+    void Seed(uint64_t seed) {
+        for (size_t i = 0; i < S.size(); i += 2) {
+            seed += 0x9E3779B97F4A7C15;
+            uint64_t z = seed;
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EB;
+            z ^= z >> 31;
+            S[i] = static_cast<uint32_t>(z);
+            S[i + 1] = static_cast<uint32_t>(z >> 32);
+        }
+    }
+
+    uint32_t Next() {
+        const uint32_t result = Rotl(S[1] * 5, 7) * 9;
+        const uint32_t t = S[1] << 9;
+        S[2] ^= S[0];
+        S[3] ^= S[1];
+        S[1] ^= S[2];
+        S[0] ^= S[3];
+        S[2] ^= t;
+        S[3] = Rotl(S[3], 11);
+        return result;
+    }
+
+private:
+    static uint32_t Rotl(uint32_t x, int k) {
+        return (x << k) | (x >> (32 - k));
+    }
+};
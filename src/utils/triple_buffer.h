@@ -0,0 +1,52 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+// Wait-free single-producer/single-consumer exchange of whole values. The writer fills
+// its back slot and swaps it with the shared middle one; the reader swaps its front slot
+// with the middle one only when a newer value is there, so it never sees a torn value
+// and neither side ever blocks the other.
+template <typename T>
+class TTripleBuffer {
+public:
+    TTripleBuffer()
+        : Middle(1)
+        , Back(0)
+        , Front(2)
+    {}
+
+    explicit TTripleBuffer(const T& initial)
+        : TTripleBuffer()
+    {
+        Slots.fill(initial);
+    }
+
+    void Publish(const T& value) {
+        Slots[Back] = value;
+        Back = Middle.exchange(Back | FreshBit, std::memory_order_acq_rel) & IndexMask;
+    }
+
+    // Takes the latest published value, if any; returns whether Read() has changed
+    bool Update() {
+        if ((Middle.load(std::memory_order_relaxed) & FreshBit) == 0) {
+            return false;
+        }
+        Front = Middle.exchange(Front, std::memory_order_acq_rel) & IndexMask;
+        return true;
+    }
+
+    const T& Read() const {
+        return Slots[Front];
+    }
+
+private:
+    static const uint8_t IndexMask = 0x3;
+    static const uint8_t FreshBit = 0x4;
+
+    std::array<T, 3> Slots;
+    std::atomic<uint8_t> Middle;
+    uint8_t Back;
+    uint8_t Front;
+};
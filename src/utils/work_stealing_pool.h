@@ -0,0 +1,162 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of workers, each with its own task deque. A worker takes its newest task
+// first and, when its deque runs dry, steals the oldest task of another worker, so
+// uneven jobs spread out without one shared queue every worker contends on.
+class TWorkStealingPool {
+public:
+    using TTask = std::function<void()>;
+
+    explicit TWorkStealingPool(size_t threads = std::thread::hardware_concurrency()) {
+        threads = threads == 0 ? 1 : threads;
+        for (size_t i = 0; i < threads; ++i) {
+            Queues.emplace_back(new TQueue);
+        }
+        for (size_t i = 0; i < threads; ++i) {
+            Workers.emplace_back([this, i]() { WorkerLoop(i); });
+        }
+    }
+
+    ~TWorkStealingPool() {
+        {
+            std::lock_guard<std::mutex> lock(StateLock);
+            Stopping = true;
+        }
+        WorkAvailable.notify_all();
+        for (auto& worker : Workers) {
+            worker.join();
+        }
+    }
+
+    size_t GetThreadsCount() const {
+        return Workers.size();
+    }
+
+    // From a worker the task goes to that worker's own deque, otherwise round-robin
+    void Submit(TTask task) {
+        const size_t index = CurrentWorker() != nullptr && CurrentWorker()->Pool == this
+            ? CurrentWorker()->Index
+            : NextQueue++ % Queues.size();
+        {
+            // Counted before it becomes visible, so a worker can never finish it first
+            std::lock_guard<std::mutex> lock(StateLock);
+            ++Pending;
+            ++Queued;
+        }
+        {
+            std::lock_guard<std::mutex> lock(Queues[index]->Lock);
+            Queues[index]->Tasks.push_back(std::move(task));
+        }
+        WorkAvailable.notify_one();
+    }
+
+    // Blocks until every submitted task has finished; rethrows the first exception a task threw
+    void Wait() {
+        std::unique_lock<std::mutex> lock(StateLock);
+        AllDone.wait(lock, [this]() { return Pending == 0; });
+        if (Error) {
+            auto error = Error;
+            Error = nullptr;
+            std::rethrow_exception(error);
+        }
+    }
+
+private:
+    struct TQueue {
+        std::mutex Lock;
+        std::deque<TTask> Tasks;
+    };
+
+    struct TWorker {
+        const TWorkStealingPool* Pool;
+        size_t Index;
+    };
+
+    std::vector<std::unique_ptr<TQueue>> Queues;
+    std::vector<std::thread> Workers;
+    std::atomic<size_t> NextQueue {0};
+
+    std::mutex StateLock;
+    std::condition_variable WorkAvailable;
+    std::condition_variable AllDone;
+    size_t Pending = 0;
+    size_t Queued = 0;
+    bool Stopping = false;
+    std::exception_ptr Error;
+private:
+    static TWorker*& CurrentWorker() {
+        static thread_local TWorker* worker = nullptr;
+        return worker;
+    }
+
+    bool TryPop(size_t index, TTask& task) {
+        for (size_t i = 0; i < Queues.size(); ++i) {
+            auto& queue = *Queues[(index + i) % Queues.size()];
+            std::lock_guard<std::mutex> lock(queue.Lock);
+            if (queue.Tasks.empty()) {
+                continue;
+            }
+            if (i == 0) {
+                task = std::move(queue.Tasks.back());
+                queue.Tasks.pop_back();
+            } else {
+                task = std::move(queue.Tasks.front());
+                queue.Tasks.pop_front();
+            }
+            return true;
+        }
+        return false;
+    }
+
+    void WorkerLoop(size_t index) {
+        TWorker self {this, index};
+        CurrentWorker() = &self;
+
+        while (true) {
+            TTask task;
+            if (TryPop(index, task)) {
+                {
+                    std::lock_guard<std::mutex> lock(StateLock);
+                    --Queued;
+                }
+                std::exception_ptr error;
+                try {
+                    task();
+                } catch (...) {
+                    error = std::current_exception();
+                }
+                Finish(error);
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(StateLock);
+            WorkAvailable.wait(lock, [this]() { return Stopping || Queued > 0; });
+            if (Stopping && Queued == 0) {
+                break;
+            }
+        }
+
+        CurrentWorker() = nullptr;
+    }
+
+    void Finish(std::exception_ptr error) {
+        std::lock_guard<std::mutex> lock(StateLock);
+        if (error && !Error) {
+            Error = error;
+        }
+        if (--Pending == 0) {
+            AllDone.notify_all();
+        }
+    }
+};
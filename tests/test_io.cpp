@@ -0,0 +1,105 @@
+#include <gtest/gtest.h>
+#include <sstream>
+#include <io/script.h>
+
+#define private public
+#include <chip8.h>
+
+TEST(TestInputScript, TestRead) {
+    std::istringstream text("# cycle key\n10 a\n\n25 F  # last\n");
+    const auto events = ReadInputScript(text);
+    ASSERT_EQ(2u, events.size());
+    ASSERT_EQ(10u, events[0].Cycle);
+    ASSERT_EQ(0xA, events[0].Key);
+    ASSERT_EQ(25u, events[1].Cycle);
+    ASSERT_EQ(0xF, events[1].Key);
+}
+
+TEST(TestInputScript, TestRejectsBadLines) {
+    std::istringstream badKey("10 1F\n");
+    ASSERT_THROW(ReadInputScript(badKey), std::runtime_error);
+    std::istringstream backwards("10 1\n5 2\n");
+    ASSERT_THROW(ReadInputScript(backwards), std::runtime_error);
+}
+
+TEST(TestInputScript, TestPollDeliversDueKeys) {
+    TScriptedInput input({{10, 1}, {20, 2}, {20, 3}});
+    TPendingKeys keys {};
+
+    input.Poll(5, keys);
+    ASSERT_TRUE(keys.empty());
+    input.Poll(10, keys);
+    ASSERT_EQ(1, keys.front());
+    ASSERT_TRUE(input.IsOpen());
+
+    // A later press replaces the one not consumed
+    input.Poll(30, keys);
+    ASSERT_EQ(1u, keys.size());
+    ASSERT_EQ(3, keys.front());
+    ASSERT_FALSE(input.IsOpen());
+}
+
+namespace {
+    // Stands in for a keyboard: presses whatever comes next every few polls, whatever the cycle
+    class TPollCountingInput : public IInputSource {
+    public:
+        void Poll(uint64_t, TPendingKeys& keys) override {
+            if (++Polls % 7 == 0 && Next < 16) {
+                keys = {};
+                keys.push(Next++);
+            }
+        }
+
+        bool IsOpen() const override {
+            return Next < 16;
+        }
+
+    private:
+        size_t Polls = 0;
+        uint8_t Next = 0;
+    };
+
+    // Waits for a key and draws its digit, moving right each time
+    const uint8_t KeyDrawingProgram[] = {
+        0xF0, 0x0A,     // 200: LD V0, K
+        0xF0, 0x29,     // 202: LD F, V0
+        0xD1, 0x25,     // 204: DRW V1, V2, 5
+        0x71, 0x05,     // 206: ADD V1, 05
+        0x12, 0x00,     // 208: JP 200
+    };
+}
+
+TEST(TestInputScript, TestRecordingReplaysTheSameRun) {
+    TChip8Machine recorded;
+    TChip8Machine replayed;
+    for (auto* machine : {&recorded, &replayed}) {
+        std::copy(std::begin(KeyDrawingProgram), std::end(KeyDrawingProgram), machine->State.Memory.begin() + 0x200);
+        machine->SetSpeed(TChip8Machine::Unthrottled);
+    }
+
+    TPollCountingInput keyboard;
+    TRecordingInput recorder(&keyboard);
+    recorded.SetInputSource(&recorder);
+    ASSERT_EQ(TChip8Machine::EExitReason::InputClosed, recorded.Execute());
+    ASSERT_EQ(16u, recorder.GetEvents().size());
+
+    std::stringstream log;
+    WriteInputScript(log, recorder.GetEvents());
+    TScriptedInput replay(ReadInputScript(log));
+    replayed.SetInputSource(&replay);
+    ASSERT_EQ(TChip8Machine::EExitReason::InputClosed, replayed.Execute());
+
+    ASSERT_EQ(recorded.GetCycles(), replayed.GetCycles());
+    ASSERT_EQ(recorded.GetVideoMemory(), replayed.GetVideoMemory());
+}
+
+TEST(TestInputScript, TestRecordingForgetsRewoundPresses) {
+    TScriptedInput keyboard({{10, 1}, {20, 2}, {30, 3}});
+    TRecordingInput recorder(&keyboard);
+    TPendingKeys keys {};
+    for (const uint64_t cycle : {10u, 20u, 30u, 15u}) {
+        recorder.Poll(cycle, keys);
+    }
+    ASSERT_EQ(1u, recorder.GetEvents().size());
+    ASSERT_EQ(10u, recorder.GetEvents().front().Cycle);
+}
@@ -0,0 +1,123 @@
+#include <gtest/gtest.h>
+#include <random>
+
+#define private public
+#include <chip8.h>
+#include <lockstep/engine.h>
+
+namespace {
+    // Arithmetic, skips and jumps the engine runs in lockstep, mixed with calls, drawing
+    // and memory writes it hands to the per-lane CPU. Lanes start with different
+    // registers, so the skips split them up and the jump back brings them together again.
+    const uint8_t LockstepProgram[] = {
+        0x6A, 0x05,     // 200: LD VA, 05
+        0x70, 0x01,     // 202: ADD V0, 01
+        0x80, 0x14,     // 204: ADD V0, V1
+        0x81, 0x25,     // 206: SUB V1, V2
+        0x82, 0x36,     // 208: SHR V2, V3
+        0x83, 0x3E,     // 20A: SHL V3, V3
+        0x84, 0x02,     // 20C: AND V4, V0
+        0x85, 0x11,     // 20E: OR V5, V1
+        0x86, 0x23,     // 210: XOR V6, V2
+        0x87, 0x07,     // 212: SUBN V7, V0
+        0x40, 0x03,     // 214: SNE V0, 03
+        0x22, 0x30,     // 216: CALL 230
+        0x31, 0x80,     // 218: SE V1, 80
+        0x6B, 0x01,     // 21A: LD VB, 01
+        0x90, 0x10,     // 21C: SNE V0, V1
+        0xA3, 0x00,     // 21E: LD I, 300
+        0x52, 0x30,     // 220: SE V2, V3
+        0xF0, 0x1E,     // 222: ADD I, V0
+        0xF0, 0x15,     // 224: LD DT, V0
+        0xF8, 0x07,     // 226: LD V8, DT
+        0xF9, 0x33,     // 228: LD B, V9
+        0x12, 0x02,     // 22A: JP 202
+        0x00, 0x00,
+        0x00, 0x00,
+        0xA2, 0x02,     // 230: LD I, 202
+        0xD1, 0x25,     // 232: DRW V1, V2, 5
+        0x00, 0xEE,     // 234: RET
+    };
+
+    void LoadProgram(TChip8Machine& machine, uint32_t seed) {
+        std::copy(std::begin(LockstepProgram), std::end(LockstepProgram), machine.State.Memory.begin() + 0x200);
+        std::mt19937 random(seed);
+        for (size_t x = 0; x < 10; ++x) {
+            machine.State.V.at(x) = seed == 0 ? 0 : static_cast<uint8_t>(random());
+        }
+    }
+
+    template <size_t Lanes>
+    void CompareWithMachines(uint32_t laneSeeds) {
+        const uint32_t ticks = 7;
+        const uint64_t instructions = 5000;
+
+        TLockstepEngine<Lanes> engine;
+        engine.SetInstructionsPerTick(ticks);
+        for (size_t lane = 0; lane < Lanes; ++lane) {
+            LoadProgram(engine.GetMachine(lane), lane % laneSeeds);
+        }
+        engine.Run(instructions / 2);
+        engine.Run(instructions - instructions / 2);
+
+        for (size_t lane = 0; lane < Lanes; ++lane) {
+            TChip8Machine expected;
+            expected.SetInstructionsPerTick(ticks);
+            LoadProgram(expected, lane % laneSeeds);
+            expected.Run(instructions);
+
+            const auto& state = engine.GetMachine(lane).State;
+            ASSERT_EQ(expected.State.V, state.V) << "lane " << lane;
+            ASSERT_EQ(expected.State.I, state.I) << "lane " << lane;
+            ASSERT_EQ(expected.State.PC, state.PC) << "lane " << lane;
+            ASSERT_EQ(expected.State.DT, state.DT) << "lane " << lane;
+            ASSERT_EQ(expected.State.Cycles, state.Cycles) << "lane " << lane;
+            ASSERT_EQ(expected.State.Memory, state.Memory) << "lane " << lane;
+            ASSERT_EQ(expected.State.VideoMemory, state.VideoMemory) << "lane " << lane;
+        }
+        ASSERT_EQ(instructions * Lanes, engine.GetLockstepInstructions() + engine.GetScalarInstructions());
+        ASSERT_GT(engine.GetLockstepInstructions(), 0u);
+    }
+}
+
+TEST(TestLockstep, TestIdenticalLanesStayTogether) {
+    TLockstepEngine<8> engine;
+    for (size_t lane = 0; lane < 8; ++lane) {
+        LoadProgram(engine.GetMachine(lane), 0);
+    }
+    engine.Run(1000);
+
+    // Only CALL, DRW, RET and LD B leave the vector path, and they never split the lanes
+    ASSERT_EQ(engine.GetScalarInstructions() % 8, 0u);
+    ASSERT_GT(engine.GetLockstepInstructions(), 4 * engine.GetScalarInstructions());
+}
+
+TEST(TestLockstep, TestMatchesCpu8) {
+    CompareWithMachines<8>(8);
+}
+
+TEST(TestLockstep, TestMatchesCpu16) {
+    CompareWithMachines<16>(3);
+}
+
+TEST(TestLockstep, TestMatchesCpu32) {
+    CompareWithMachines<32>(32);
+}
+
+TEST(TestLockstep, TestHaltsLaneOnClosedInput) {
+    TLockstepEngine<8> engine;
+    // LD V0, 1; LD V1, K on lanes with V2 == 0, otherwise loop
+    const uint8_t program[] = {0x60, 0x01, 0x32, 0x00, 0x12, 0x08, 0xF1, 0x0A, 0x12, 0x08};
+    for (size_t lane = 0; lane < 8; ++lane) {
+        auto& state = engine.GetMachine(lane).State;
+        std::copy(std::begin(program), std::end(program), state.Memory.begin() + 0x200);
+        state.V.at(2) = lane % 2;
+    }
+    engine.Run(10);
+
+    for (size_t lane = 0; lane < 8; ++lane) {
+        ASSERT_EQ(lane % 2 == 0, engine.IsHalted(lane)) << "lane " << lane;
+    }
+    ASSERT_EQ(0x206, engine.GetMachine(0).State.PC);
+    ASSERT_EQ(10u, engine.GetMachine(1).State.Cycles);
+}
@@ -3,77 +3,115 @@
 #define private public
 #include <chip8.h>
 #include <opcode/parser.h>
+#include <io/script.h>
 
-class TestOpcodes : public ::testing::Test {
+namespace {
+    const TChip8Machine::ECpuBackend AllBackends[] = {
+        TChip8Machine::ECpuBackend::Dispatch,
+        TChip8Machine::ECpuBackend::Threaded,
+        TChip8Machine::ECpuBackend::Blocks,
+    };
+}
+
+// Every opcode test runs once per CPU backend
+class TestOpcodes : public ::testing::TestWithParam<TChip8Machine::ECpuBackend> {
 
 protected:
     TestOpcodes()
-     : Cpu(State) {};
+     : Cpu(State, GetParam()) {};
 
 
     virtual void SetUp() {
+        State.Memory.fill(0);
+        State.V.fill(0);
+        State.PC = 0x200;
+        State.I = 0;
+        State.Cycles = 0;
+    }
 
+    // Runs one instruction at PC through the backend. A jump to the next word follows it,
+    // so a block translated from there ends without decoding whatever memory comes after
+    void Execute(uint16_t word) {
+        const uint16_t pc = State.PC;
+        const uint16_t next = pc + 2;
+        State.Memory[pc] = word >> 8;
+        State.Memory[pc + 1] = word & 0xFF;
+        State.Memory[next] = 0x10 | (next >> 8);
+        State.Memory[next + 1] = next & 0xFF;
+        Cpu.InvalidateDecodeCache(pc, 4);
+        Cpu.Run(1);
     }
 
     TChip8Machine::TState State;
     TChip8Machine::TCPU Cpu;
 };
 
-TEST_F(TestOpcodes, TestRET) {
-    State.PC = 0;
+#ifdef INSTANTIATE_TEST_SUITE_P
+INSTANTIATE_TEST_SUITE_P(Backends, TestOpcodes, ::testing::ValuesIn(AllBackends));
+#else
+INSTANTIATE_TEST_CASE_P(Backends, TestOpcodes, ::testing::ValuesIn(AllBackends));
+#endif
+
+TEST_P(TestOpcodes, TestRET) {
     State.Stack.push(42);
     State.Stack.push(43);
 
-    Cpu.Return(TOpcode(EOperationType::RET, TEmpty{}));
+    Execute(0x00EE);
 
     ASSERT_EQ(43, State.PC);
-    ASSERT_EQ(1, State.Stack.size());
+    ASSERT_EQ(1u, State.Stack.size());
     ASSERT_EQ(42, State.Stack.top());
 }
 
-TEST_F(TestOpcodes, TestCALL) {
-    State.PC = 42;
+TEST_P(TestOpcodes, TestCallStackIsBounded) {
+    for (size_t i = 0; i < CHIP8_STACK_DEPTH; ++i) {
+        Execute(0x2300);
+    }
+    ASSERT_THROW(Execute(0x2300), std::overflow_error);
+    State.Stack = {};
+    ASSERT_THROW(Execute(0x00EE), std::underflow_error);
+}
 
+TEST_P(TestOpcodes, TestCALL) {
     ASSERT_TRUE(State.Stack.empty());
-    Cpu.Call(TOpcode(EOperationType::CALL, TAddress{.Value = 0x123}));
+    Execute(0x2123);
 
     ASSERT_EQ(0x123, State.PC);
-    ASSERT_EQ(1, State.Stack.size());
-    ASSERT_EQ(42, State.Stack.top());
+    ASSERT_EQ(1u, State.Stack.size());
+    ASSERT_EQ(0x202, State.Stack.top());
 }
 
-TEST_F(TestOpcodes, TestADDI) {
-    State.I = 0;
+TEST_P(TestOpcodes, TestADDI) {
     State.V.at(1) = 42;
     State.V.at(2) = 10;
-    Cpu.AddWithAddr(TOpcode(EOperationType::ADD_ADDR, TVar {.X = 1}));
+    Execute(0xF11E);
     ASSERT_EQ(42, State.I);
-    Cpu.AddWithAddr(TOpcode(EOperationType::ADD_ADDR, TVar {.X = 2}));
+    Execute(0xF21E);
     ASSERT_EQ(52, State.I);
 
     ASSERT_EQ(42, State.V.at(1));
     ASSERT_EQ(10, State.V.at(2));
 }
 
-TEST_F(TestOpcodes, TestADDCONST) {
+TEST_P(TestOpcodes, TestADDCONST) {
     State.V.at(1) = 10;
-    Cpu.AddConst(TOpcode(EOperationType::ADD_CONST, TVarWithConst {.X = 1, .Const = 42}));
+    Execute(0x712A);
     ASSERT_EQ(52, State.V.at(1));
 
     State.V.at(1) = 200;
-    Cpu.AddConst(TOpcode(EOperationType::ADD_CONST, TVarWithConst {.X = 1, .Const = 100}));
+    Execute(0x7164);
     ASSERT_EQ(44, State.V.at(1));
 
     State.V.at(1) = 5;
-    Cpu.AddConst(TOpcode(EOperationType::ADD_CONST, TVarWithConst {.X = 1, .Const = 0xFF}));
+    Execute(0x71FF);
     ASSERT_EQ(4, State.V.at(1));
 }
 
-TEST_F(TestOpcodes, TestADDVAR) {
+TEST_P(TestOpcodes, TestADDVAR) {
     State.V.at(1) = 10;
     State.V.at(2) = 5;
     State.V.at(0xF) = 0;
-    Cpu.AddWithVar(TOpcode(EOperationType::ADD_VAR, TTwoVars {.X = 1, .Y = 2}));
+    Execute(0x8124);
     ASSERT_EQ(15, State.V.at(1));
     ASSERT_EQ(5, State.V.at(2));
     ASSERT_EQ(0, State.V.at(0xF));
@@ -81,7 +119,7 @@ TEST_F(TestOpcodes, TestADDVAR) {
     State.V.at(1) = 10;
     State.V.at(2) = 5;
     State.V.at(0xF) = 1;
-    Cpu.AddWithVar(TOpcode(EOperationType::ADD_VAR, TTwoVars {.X = 2, .Y = 1}));
+    Execute(0x8214);
     ASSERT_EQ(10, State.V.at(1));
     ASSERT_EQ(15, State.V.at(2));
     ASSERT_EQ(0, State.V.at(0xF));
@@ -90,7 +128,7 @@ TEST_F(TestOpcodes, TestADDVAR) {
     State.V.at(1) = 10;
     State.V.at(2) = 250;
     State.V.at(0xF) = 0;
-    Cpu.AddWithVar(TOpcode(EOperationType::ADD_VAR, TTwoVars {.X = 2, .Y = 1}));
+    Execute(0x8214);
     ASSERT_EQ(10, State.V.at(1));
     ASSERT_EQ(4, State.V.at(2));
     ASSERT_EQ(1, State.V.at(0xF));
@@ -98,27 +136,302 @@ TEST_F(TestOpcodes, TestADDVAR) {
     State.V.at(1) = 10;
     State.V.at(2) = 250;
     State.V.at(0xF) = 1;
-    Cpu.AddWithVar(TOpcode(EOperationType::ADD_VAR, TTwoVars {.X = 1, .Y = 2}));
+    Execute(0x8124);
     ASSERT_EQ(4, State.V.at(1));
     ASSERT_EQ(250, State.V.at(2));
     ASSERT_EQ(1, State.V.at(0xF));
 }
 
 
-TEST_F(TestOpcodes, TestSEVAR) {
-    State.PC = 0;
+TEST_P(TestOpcodes, TestSEVAR) {
     State.V.at(1) = 2;
     State.V.at(2) = 2;
-    Cpu.SkipIfEqualToVar(TOpcode(EOperationType::SE_VAR, TTwoVars {.X = 1, .Y = 2}));
-    ASSERT_EQ(2, State.PC);
+    Execute(0x5120);
+    ASSERT_EQ(0x204, State.PC);
     ASSERT_EQ(2, State.V.at(1));
     ASSERT_EQ(2, State.V.at(2));
 
-    State.PC = 2;
+    State.PC = 0x200;
     State.V.at(1) = 2;
     State.V.at(2) = 3;
-    Cpu.SkipIfEqualToVar(TOpcode(EOperationType::SE_VAR, TTwoVars {.X = 1, .Y = 2}));
-    ASSERT_EQ(2, State.PC);
+    Execute(0x5120);
+    ASSERT_EQ(0x202, State.PC);
     ASSERT_EQ(2, State.V.at(1));
     ASSERT_EQ(3, State.V.at(2));
-}
\ No newline at end of file
+}
+
+TEST_P(TestOpcodes, TestDecodeCacheInvalidation) {
+    // LD V0, 1; JP 200
+    const uint8_t program[] = {0x60, 0x01, 0x12, 0x00};
+    std::copy(std::begin(program), std::end(program), State.Memory.begin() + 0x200);
+
+    Cpu.Run(1);
+    ASSERT_EQ(0x202, State.PC);
+    ASSERT_EQ(1, State.V.at(0));
+
+    State.PC = 0x300;
+    State.I = 0x201;
+    State.V.at(0) = 0x2A;
+    Execute(0xF055);
+
+    State.PC = 0x200;
+    Cpu.Run(1);
+    ASSERT_EQ(0x202, State.PC);
+    ASSERT_EQ(0x2A, State.V.at(0));
+}
+
+TEST_P(TestOpcodes, TestMemoryAccessPastTop) {
+    State.PC = 0x300;
+    State.I = 0xFFE;
+    State.V.at(0) = 123;
+#if CHIP8_CHECKED_ACCESS
+    try {
+        Execute(0xF033);
+        FAIL() << "expected an access violation";
+    } catch (const std::out_of_range& e) {
+        ASSERT_STREQ("Memory access at 1000 out of range at 300", e.what());
+    }
+#else
+    // Addresses wrap like the 12-bit bus, and so does decode cache invalidation.
+    // LD V1, 1; JP 000
+    const uint8_t program[] = {0x61, 0x01, 0x10, 0x00};
+    std::copy(std::begin(program), std::end(program), State.Memory.begin());
+    State.PC = 0;
+    Cpu.Run(1);
+    ASSERT_TRUE(Cpu.DecodeCache[0] || Cpu.BlockCache[0]);
+
+    State.PC = 0x300;
+    Execute(0xF033);
+    ASSERT_EQ(1, State.Memory[0xFFE]);
+    ASSERT_EQ(2, State.Memory[0xFFF]);
+    ASSERT_EQ(3, State.Memory[0x000]);
+    ASSERT_FALSE(Cpu.DecodeCache[0]);
+    ASSERT_FALSE(Cpu.BlockCache[0]);
+#endif
+}
+
+TEST_P(TestOpcodes, TestDRAW) {
+    State.VideoMemory.fill(0);
+    State.Memory.at(0x300) = 0xF0;
+    State.Memory.at(0x301) = 0x90;
+    State.I = 0x300;
+    State.V.at(0) = 62;
+    State.V.at(1) = 31;
+
+    Execute(0xD012);
+    ASSERT_EQ(0xC000000000000003, State.VideoMemory.at(31));
+    ASSERT_EQ(0x4000000000000002u, State.VideoMemory.at(0));
+    ASSERT_TRUE(GetPixel(State.VideoMemory, 0, 31));
+    ASSERT_FALSE(GetPixel(State.VideoMemory, 2, 31));
+    ASSERT_EQ(0, State.V.at(0xF));
+
+    Execute(0xD012);
+    ASSERT_EQ(0u, State.VideoMemory.at(31));
+    ASSERT_EQ(0u, State.VideoMemory.at(0));
+    ASSERT_EQ(1, State.V.at(0xF));
+}
+
+TEST_P(TestOpcodes, TestCLS) {
+    State.VideoMemory.fill(0xFFFFFFFFFFFFFFFF);
+    Execute(0x00E0);
+    for (auto row : State.VideoMemory) {
+        ASSERT_EQ(0u, row);
+    }
+}
+
+TEST_P(TestOpcodes, TestDrawPublishesFrame) {
+    TFrameExchange frames;
+    Cpu.SetVideoSink(&frames);
+
+    State.VideoMemory.fill(0);
+    State.Memory.at(0x300) = 0x80;
+    State.I = 0x300;
+    State.V.at(0) = 0;
+    Execute(0xD001);
+
+    ASSERT_TRUE(frames.Update());
+    ASSERT_TRUE(GetPixel(frames.Read(), 0, 0));
+
+    Execute(0x00E0);
+    ASSERT_TRUE(frames.Update());
+    ASSERT_FALSE(GetPixel(frames.Read(), 0, 0));
+}
+
+TEST_P(TestOpcodes, TestLoadKeyFromInputSource) {
+    TScriptedInput input({{0, 0xA}, {100, 0xB}});
+    Cpu.SetInputSource(&input);
+
+    State.PressedKeys = {};
+    Execute(0xF30A);
+    ASSERT_EQ(0xA, State.V.at(3));
+    ASSERT_EQ(0x202, State.PC);
+
+    // The next press is still ahead: wait by staying on the instruction
+    Execute(0xF30A);
+    ASSERT_EQ(0x202, State.PC);
+
+    State.Cycles = 99;
+    Execute(0xF30A);
+    ASSERT_EQ(0xB, State.V.at(3));
+    ASSERT_EQ(0x204, State.PC);
+
+    // Nothing left to deliver: the CPU gives up and stays on the instruction
+    ASSERT_THROW(Execute(0xF30A), TInputClosed);
+    ASSERT_EQ(0x204, State.PC);
+}
+
+namespace {
+    const uint8_t TestProgram[] = {
+        0x60, 0x05, // LD V0, 5
+        0x61, 0x03, // LD V1, 3
+        0x80, 0x14, // ADD V0, V1
+        0x30, 0x08, // SE V0, 8
+        0x62, 0x01, // LD V2, 1 (skipped)
+        0xA3, 0x00, // LD I, 300
+        0xF0, 0x33, // LD B, V0
+        0x22, 0x14, // CALL 214
+        0x70, 0x01, // ADD V0, 1
+        0x12, 0x12, // JP 212
+        0x83, 0x00, // LD V3, V0
+        0x00, 0xEE, // RET
+    };
+
+    void LoadTestProgram(TChip8Machine::TState& state) {
+        state.Memory.fill(0);
+        state.V.fill(0);
+        state.I = 0;
+        state.PC = 0x200;
+        std::copy(std::begin(TestProgram), std::end(TestProgram), state.Memory.begin() + 0x200);
+    }
+}
+
+TEST(TestBackends, TestBackendsAgree) {
+    for (auto backend : AllBackends) {
+        TChip8Machine::TState state;
+        LoadTestProgram(state);
+
+        TChip8Machine::TCPU cpu(state, backend);
+        cpu.Run(20);
+
+        ASSERT_EQ(0x212, state.PC);
+        ASSERT_EQ(9, state.V.at(0));
+        ASSERT_EQ(3, state.V.at(1));
+        ASSERT_EQ(0, state.V.at(2));
+        ASSERT_EQ(8, state.V.at(3));
+        ASSERT_EQ(0x300, state.I);
+        ASSERT_EQ(8, state.Memory.at(0x302));
+        ASSERT_TRUE(state.Stack.empty());
+    }
+}
+
+TEST(TestBackends, TestSelfModifyingCode) {
+    const uint8_t program[] = {
+        0x70, 0x01, // ADD V0, 1
+        0xA2, 0x09, // LD I, 209
+        0xF0, 0x55, // LD [I], V0
+        0x62, 0x00, // LD V2, 0
+        0x61, 0x00, // LD V1, <patched>
+        0x12, 0x00, // JP 200
+    };
+
+    for (auto backend : AllBackends) {
+        TChip8Machine::TState state;
+        LoadTestProgram(state);
+        std::copy(std::begin(program), std::end(program), state.Memory.begin() + 0x200);
+
+        TChip8Machine::TCPU cpu(state, backend);
+        cpu.Run(6);
+        ASSERT_EQ(1, state.V.at(1));
+
+        cpu.Run(6);
+        ASSERT_EQ(0x200, state.PC);
+        ASSERT_EQ(2, state.V.at(0));
+        ASSERT_EQ(2, state.V.at(1));
+    }
+}
+
+TEST(TestBackends, TestFusedBlocks) {
+    const uint8_t program[] = {
+        0x60, 0x05, // LD V0, 5
+        0x30, 0x05, // SE V0, 5
+        0x61, 0x01, // LD V1, 1 (skipped)
+        0x70, 0x01, // ADD V0, 1
+        0x40, 0x06, // SNE V0, 6
+        0x62, 0x01, // LD V2, 1
+        0x12, 0x0C, // JP 20C
+    };
+
+    for (auto mode : {TChip8Machine::EFusionMode::Off, TChip8Machine::EFusionMode::Profile}) {
+        TChip8Machine::TState state;
+        LoadTestProgram(state);
+        std::copy(std::begin(program), std::end(program), state.Memory.begin() + 0x200);
+
+        TChip8Machine::TCPU cpu(state, TChip8Machine::ECpuBackend::Blocks);
+        cpu.SetFusionMode(mode);
+        cpu.Run(1);
+        cpu.Run(5);
+
+        ASSERT_EQ(0x20C, state.PC);
+        ASSERT_EQ(6, state.V.at(0));
+        ASSERT_EQ(0, state.V.at(1));
+        ASSERT_EQ(1, state.V.at(2));
+
+        uint64_t hits = 0;
+        for (const auto& stat : cpu.GetFusionStats()) {
+            hits += stat.Hits;
+            if (stat.Name == std::string("ADD Vx, SNE")) {
+                ASSERT_EQ(mode == TChip8Machine::EFusionMode::Profile ? 1u : 0u, stat.Hits);
+            }
+        }
+        ASSERT_EQ(mode == TChip8Machine::EFusionMode::Profile ? 1u : 0u, hits);
+    }
+}
+
+TEST(TestMachine, TestHeadlessRun) {
+    TChip8Machine machine;
+    // LD V0, 5; ADD V0, 1; LD V1, K
+    const uint8_t program[] = {0x60, 0x05, 0x70, 0x01, 0xF1, 0x0A};
+    std::copy(std::begin(program), std::end(program), machine.State.Memory.begin() + 0x200);
+
+    machine.Run(2);
+    ASSERT_EQ(6, machine.State.V.at(0));
+
+    // Without an input source Execute returns once the program waits for a key
+    machine.Execute();
+    ASSERT_EQ(0x204, machine.State.PC);
+}
+
+TEST(TestMachine, TestVirtualClockTicksTimers) {
+    TChip8Machine machine;
+    machine.SetInstructionsPerTick(4);
+    // LD V0, 5; LD DT, V0; JP 204
+    const uint8_t program[] = {0x60, 0x05, 0xF0, 0x15, 0x12, 0x04};
+    std::copy(std::begin(program), std::end(program), machine.State.Memory.begin() + 0x200);
+
+    machine.Run(2);
+    ASSERT_EQ(5, machine.State.DT);
+    machine.Run(2);
+    ASSERT_EQ(4, machine.State.DT);
+    machine.Run(3);
+    ASSERT_EQ(4, machine.State.DT);
+    machine.Run(1);
+    ASSERT_EQ(3, machine.State.DT);
+    machine.Run(100);
+    ASSERT_EQ(0, machine.State.DT);
+}
+
+TEST(TestMachine, TestUnthrottledExecute) {
+    TChip8Machine machine;
+    machine.SetSpeed(TChip8Machine::Unthrottled);
+    // LD V0, FF; LD DT, V0; JP 204
+    const uint8_t program[] = {0x60, 0xFF, 0xF0, 0x15, 0x12, 0x04};
+    std::copy(std::begin(program), std::end(program), machine.State.Memory.begin() + 0x200);
+
+    // 10,000 frames of emulated time without waiting for them
+    const auto start = std::chrono::steady_clock::now();
+    machine.Execute(10000);
+    ASSERT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(10));
+
+    ASSERT_EQ(10000 * TChip8Machine::DefaultInstructionsPerTick, machine.State.Cycles);
+    ASSERT_EQ(0, machine.State.DT);
+}
@@ -0,0 +1,40 @@
+#include <gtest/gtest.h>
+#include <opcode/parser.h>
+
+TEST(TestParser, TestParseOperands) {
+    const auto draw = TOpcodeParser::Parse(0xD123);
+    ASSERT_EQ(EOperationType::DRAW, draw.GetOperationType());
+    ASSERT_EQ(1, draw.GetArgs<TTwoVarsWithConst>().X);
+    ASSERT_EQ(2, draw.GetArgs<TTwoVarsWithConst>().Y);
+    ASSERT_EQ(3, draw.GetArgs<TTwoVarsWithConst>().Const);
+
+    const auto jump = TOpcodeParser::Parse(0x1ABC);
+    ASSERT_EQ(EOperationType::JUMP, jump.GetOperationType());
+    ASSERT_EQ(0xABC, jump.GetArgs<TAddress>().Value);
+
+    const auto addConst = TOpcodeParser::Parse(0x7E42);
+    ASSERT_EQ(EOperationType::ADD_CONST, addConst.GetOperationType());
+    ASSERT_EQ(0xE, addConst.GetArgs<TVarWithConst>().X);
+    ASSERT_EQ(0x42, addConst.GetArgs<TVarWithConst>().Const);
+}
+
+TEST(TestParser, TestParseSubcodes) {
+    ASSERT_EQ(EOperationType::CLS, TOpcodeParser::Parse(0x00E0).GetOperationType());
+    ASSERT_EQ(EOperationType::RET, TOpcodeParser::Parse(0x00EE).GetOperationType());
+    ASSERT_EQ(EOperationType::SHL_VAR, TOpcodeParser::Parse(0x812E).GetOperationType());
+    ASSERT_EQ(EOperationType::SNE_KEY, TOpcodeParser::Parse(0xE3A1).GetOperationType());
+    ASSERT_EQ(EOperationType::STORE_BCD_VAR, TOpcodeParser::Parse(0xF533).GetOperationType());
+}
+
+TEST(TestParser, TestParseUnknown) {
+    ASSERT_EQ(EOperationType::UNKNOWN, TOpcodeParser::Parse(0x0123).GetOperationType());
+    ASSERT_EQ(EOperationType::UNKNOWN, TOpcodeParser::Parse(0x8008).GetOperationType());
+    ASSERT_EQ(EOperationType::UNKNOWN, TOpcodeParser::Parse(0xB000).GetOperationType());
+    ASSERT_EQ(EOperationType::UNKNOWN, TOpcodeParser::Parse(0xFFFF).GetOperationType());
+}
+
+TEST(TestParser, TestOpcodeFromArgs) {
+    const TOpcode opcode(EOperationType::SE_VAR, TTwoVars {.X = 3, .Y = 4});
+    ASSERT_EQ(3, opcode.GetArgs<TTwoVars>().X);
+    ASSERT_EQ(4, opcode.GetArgs<TTwoVars>().Y);
+}
@@ -0,0 +1,233 @@
+#include <gtest/gtest.h>
+#include <cstring>
+#include <random>
+#include <sstream>
+
+#define private public
+#include <chip8.h>
+
+namespace {
+    // Counts V0 up, calls a subroutine that stores it to 0x300 and draws, and loops
+    const uint8_t Program[] = {
+        0x70, 0x01,     // 200: ADD V0, 01
+        0xF0, 0x15,     // 202: LD DT, V0
+        0x22, 0x08,     // 204: CALL 208
+        0x12, 0x00,     // 206: JP 200
+        0xA3, 0x00,     // 208: LD I, 300
+        0xF0, 0x55,     // 20A: LD [I], V0
+        0xD1, 0x21,     // 20C: DRW V1, V2, 1
+        0x00, 0xEE,     // 20E: RET
+    };
+
+    void LoadProgram(TChip8Machine& machine) {
+        std::copy(std::begin(Program), std::end(Program), machine.State.Memory.begin() + 0x200);
+    }
+
+    bool SameSnapshot(const TSnapshot& a, const TSnapshot& b) {
+        return std::memcmp(&a, &b, sizeof(TSnapshot)) == 0;
+    }
+}
+
+TEST(TestSnapshot, TestRestoreReplaysTheSameRun) {
+    TChip8Machine machine;
+    LoadProgram(machine);
+    machine.Run(1004);
+    machine.State.PressedKeys.push(7);
+    const auto checkpoint = machine.SaveState();
+    ASSERT_EQ(1, checkpoint.StackDepth);
+    ASSERT_EQ(1, checkpoint.KeysCount);
+
+    machine.Run(500);
+    const auto expected = machine.SaveState();
+
+    machine.LoadState(checkpoint);
+    ASSERT_TRUE(SameSnapshot(checkpoint, machine.SaveState()));
+    machine.Run(500);
+    ASSERT_TRUE(SameSnapshot(expected, machine.SaveState()));
+}
+
+TEST(TestSnapshot, TestRandomIsSeededAndRestored) {
+    // RND V0, FF; LD [I], V0; ADD I, V1; JP 200 - fills memory from 0x300 with random bytes
+    const uint8_t program[] = {0xC0, 0xFF, 0xF0, 0x55, 0xF1, 0x1E, 0x12, 0x00};
+    TChip8Machine first;
+    TChip8Machine second;
+    for (auto* machine : {&first, &second}) {
+        std::copy(std::begin(program), std::end(program), machine->State.Memory.begin() + 0x200);
+        machine->State.I = 0x300;
+        machine->State.V[1] = 1;
+        machine->SetRandomSeed(42);
+    }
+    first.Run(400);
+    const auto checkpoint = first.SaveState();
+    first.Run(400);
+    second.Run(800);
+    ASSERT_TRUE(SameSnapshot(first.SaveState(), second.SaveState()));
+
+    second.LoadState(checkpoint);
+    second.Run(400);
+    ASSERT_TRUE(SameSnapshot(first.SaveState(), second.SaveState()));
+
+    second.LoadState(checkpoint);
+    second.SetRandomSeed(43);
+    second.Run(400);
+    ASSERT_FALSE(SameSnapshot(first.SaveState(), second.SaveState()));
+}
+
+TEST(TestSnapshot, TestRestoreRedecodesChangedCode) {
+    TChip8Machine machine;
+    machine.SetCpuBackend(TChip8Machine::ECpuBackend::Blocks);
+    LoadProgram(machine);
+    const auto original = machine.SaveState();
+
+    // LD V0, 42 instead of ADD V0, 1
+    auto patched = original;
+    patched.Memory[0x200] = 0x60;
+    patched.Memory[0x201] = 0x42;
+
+    machine.Run(1);
+    ASSERT_EQ(1, machine.State.V.at(0));
+    machine.LoadState(patched);
+    machine.Run(1);
+    ASSERT_EQ(0x42, machine.State.V.at(0));
+    machine.LoadState(original);
+    machine.Run(1);
+    ASSERT_EQ(1, machine.State.V.at(0));
+}
+
+TEST(TestSnapshot, TestFileRoundTrip) {
+    TChip8Machine machine;
+    LoadProgram(machine);
+    machine.Run(100);
+    const auto snapshot = machine.SaveState();
+
+    std::stringstream file;
+    WriteSnapshot(file, snapshot);
+    ASSERT_EQ(sizeof(TSnapshot), file.str().size());
+    ASSERT_TRUE(SameSnapshot(snapshot, ReadSnapshot(file)));
+
+    std::string corrupt = file.str();
+    corrupt[0] = 'X';
+    std::stringstream corruptFile(corrupt);
+    ASSERT_THROW(ReadSnapshot(corruptFile), std::runtime_error);
+    std::stringstream truncated(file.str().substr(0, 100));
+    ASSERT_THROW(ReadSnapshot(truncated), std::runtime_error);
+}
+
+TEST(TestSnapshot, TestDeltaWorksBothWays) {
+    TChip8Machine machine;
+    LoadProgram(machine);
+    machine.Run(100);
+    const auto before = machine.SaveState();
+    machine.Run(4);
+    const auto after = machine.SaveState();
+
+    const auto delta = EncodeDelta(before, after);
+    ASSERT_LT(delta.size(), 64u);
+
+    auto snapshot = before;
+    ApplyDelta(delta, snapshot);
+    ASSERT_TRUE(SameSnapshot(after, snapshot));
+    ApplyDelta(delta, snapshot);
+    ASSERT_TRUE(SameSnapshot(before, snapshot));
+
+    ASSERT_TRUE(EncodeDelta(after, after).empty());
+}
+
+TEST(TestSnapshot, TestDeltaOfScatteredChanges) {
+    // Changes at every alignment and run length the word-at-a-time scan has to get right
+    std::mt19937 random(17);
+    TSnapshot before;
+    auto* bytes = reinterpret_cast<uint8_t*>(&before);
+    for (size_t i = 0; i < sizeof(TSnapshot); ++i) {
+        bytes[i] = random();
+    }
+    for (size_t changes = 1; changes < 200; changes *= 3) {
+        TSnapshot after = before;
+        auto* changed = reinterpret_cast<uint8_t*>(&after);
+        for (size_t i = 0; i < changes; ++i) {
+            const size_t pos = random() % sizeof(TSnapshot);
+            for (size_t j = pos; j < std::min(pos + random() % 20, sizeof(TSnapshot)); ++j) {
+                changed[j] ^= 1 + random() % 255;
+            }
+        }
+        auto snapshot = before;
+        ApplyDelta(EncodeDelta(before, after), snapshot);
+        ASSERT_TRUE(SameSnapshot(after, snapshot));
+    }
+}
+
+TEST(TestRewind, TestRewindRestoresEarlierTicks) {
+    TChip8Machine machine;
+    LoadProgram(machine);
+    machine.EnableRewind(1 << 20);
+    ASSERT_FALSE(machine.Rewind(1));
+
+    std::vector<TSnapshot> ticks;
+    for (size_t i = 0; i < 100; ++i) {
+        machine.Run(TChip8Machine::DefaultInstructionsPerTick);
+        ticks.push_back(machine.SaveState());
+    }
+    ASSERT_EQ(100u, machine.RewindBuffer->GetFramesCount());
+
+    ASSERT_TRUE(machine.Rewind(10));
+    ASSERT_TRUE(SameSnapshot(ticks.at(89), machine.SaveState()));
+
+    // The rewound-over ticks are gone, and running on records new history
+    machine.Run(TChip8Machine::DefaultInstructionsPerTick);
+    ASSERT_TRUE(SameSnapshot(ticks.at(90), machine.SaveState()));
+    ASSERT_TRUE(machine.Rewind(1));
+    ASSERT_TRUE(SameSnapshot(ticks.at(89), machine.SaveState()));
+
+    ASSERT_TRUE(machine.Rewind(1000));
+    ASSERT_TRUE(SameSnapshot(ticks.at(0), machine.SaveState()));
+}
+
+TEST(TestRewind, TestOldestHistoryIsDropped) {
+    // Room for the snapshot waiting to be encoded and 4 KiB of deltas
+    const size_t maxBytes = sizeof(TSnapshot) + 4096;
+    TRewindBuffer buffer(maxBytes);
+    TChip8Machine machine;
+    LoadProgram(machine);
+    std::vector<TSnapshot> ticks;
+    for (size_t i = 0; i < 1000; ++i) {
+        machine.Run(TChip8Machine::DefaultInstructionsPerTick);
+        ticks.push_back(machine.SaveState());
+        buffer.Push(ticks.back());
+    }
+    ASSERT_LE(buffer.GetBytes(), maxBytes);
+    const size_t frames = buffer.GetFramesCount();
+    ASSERT_GT(frames, 10u);
+    ASSERT_LT(frames, 1000u);
+
+    TSnapshot oldest;
+    ASSERT_TRUE(buffer.Rewind(frames, oldest));
+    ASSERT_TRUE(SameSnapshot(ticks.at(1000 - frames), oldest));
+}
+
+TEST(TestRewind, TestPendingSnapshotsStayWithinBudget) {
+    const size_t maxBytes = 8 * sizeof(TSnapshot);
+    TRewindBuffer buffer(maxBytes);
+    TChip8Machine machine;
+    LoadProgram(machine);
+    TSnapshot snapshot = machine.SaveState();
+    std::mt19937 random(17);
+    for (size_t i = 0; i < 20000; ++i) {
+        // Whole-memory changes keep the worker busy while the pushes only copy
+        for (uint8_t& byte : snapshot.Memory) {
+            byte = static_cast<uint8_t>(random());
+        }
+        buffer.Push(snapshot);
+
+        std::lock_guard<std::mutex> lock(buffer.Lock);
+        ASSERT_LE(buffer.Pending.size(), TRewindBuffer::MaxPending);
+        ASSERT_LE(buffer.Pending.size() + buffer.Spare.size(), TRewindBuffer::MaxPending + 2);
+        if (!buffer.Deltas.empty()) {
+            ASSERT_LE(buffer.Bytes + buffer.Pending.size() * sizeof(TSnapshot), maxBytes);
+        }
+    }
+    ASSERT_LE(buffer.GetBytes(), maxBytes);
+
+    TSnapshot latest;
+    ASSERT_TRUE(buffer.Rewind(0, latest));
+    ASSERT_TRUE(SameSnapshot(snapshot, latest));
+}
@@ -0,0 +1,278 @@
+#include <gtest/gtest.h>
+#include <csignal>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <sys/resource.h>
+
+#define private public
+#include <chip8.h>
+#include <opcode/disasm.h>
+#include <opcode/parser.h>
+#include <trace/trace.h>
+
+namespace {
+    std::string TempPath(const std::string& name) {
+        const char* dir = std::getenv("TMPDIR");
+        return std::string(dir && *dir ? dir : "/tmp") + "/" + name;
+    }
+}
+
+TEST(TestTrace, TestDisassemble) {
+    ASSERT_EQ("LD I, 2A0", Disassemble(TOpcodeParser::Parse(0xA2A0)));
+    ASSERT_EQ("DRW V1, V2, 5", Disassemble(TOpcodeParser::Parse(0xD125)));
+    ASSERT_EQ("SE V3, 10", Disassemble(TOpcodeParser::Parse(0x3310)));
+    ASSERT_EQ("???", Disassemble(TOpcodeParser::Parse(0xFFFF)));
+}
+
+TEST(TestTrace, TestRingKeepsLatest) {
+    TTraceBuffer buffer(3);
+    for (uint16_t pc = 0; pc < 10; ++pc) {
+        TTraceRecord record = {};
+        record.PC = pc;
+        buffer.Push(record);
+    }
+
+    const auto records = buffer.Snapshot();
+    ASSERT_EQ(10u, buffer.GetTotalCount());
+    ASSERT_EQ(3u, records.size());
+    ASSERT_EQ(7, records.front().PC);
+    ASSERT_EQ(9, records.back().PC);
+}
+
+TEST(TestTrace, TestRingDropsTheSlotBeingOverwritten) {
+    TTraceBuffer buffer(7);
+    for (uint16_t pc = 0; pc < 7; ++pc) {
+        TTraceRecord record = {};
+        record.PC = pc;
+        buffer.Push(record);
+    }
+    ASSERT_EQ(7u, buffer.Snapshot().size());
+
+    // The eighth record fills the ring; the oldest one shares the slot written next
+    TTraceRecord record = {};
+    record.PC = 7;
+    buffer.Push(record);
+    const auto records = buffer.Snapshot();
+    ASSERT_EQ(7u, records.size());
+    ASSERT_EQ(1, records.front().PC);
+    ASSERT_EQ(7, records.back().PC);
+}
+
+#if CHIP8_TRACE_LEVEL > 0
+TEST(TestTrace, TestCpuRecordsInstructions) {
+    TChip8Machine::TState state;
+    state.Memory.fill(0);
+    state.PC = 0x200;
+    const uint8_t program[] = {0x60, 0x05, 0xA3, 0x00, 0x12, 0x04};
+    std::copy(std::begin(program), std::end(program), state.Memory.begin() + 0x200);
+
+    TTraceBuffer buffer(16);
+    TChip8Machine::TCPU cpu(state);
+    cpu.SetTrace(&buffer);
+    state.Cycles = 0;
+    cpu.Run(4);
+
+    const auto records = buffer.Snapshot();
+    ASSERT_EQ(4u, records.size());
+
+    ASSERT_EQ(1u, records[0].Cycle);
+    ASSERT_EQ(0x200, records[0].PC);
+    ASSERT_EQ(0x6005, records[0].Word);
+    ASSERT_EQ(0, records[0].Register);
+    ASSERT_EQ(5, records[0].Value);
+
+    ASSERT_EQ(0x202, records[1].PC);
+    ASSERT_EQ(0x300, records[1].I);
+    ASSERT_EQ(TTraceRecord::NoRegister, records[1].Register);
+
+    ASSERT_EQ(4u, records[3].Cycle);
+    ASSERT_EQ(0x1204, records[3].Word);
+}
+#else
+TEST(TestTrace, TestRingIsCompiledOut) {
+    TChip8Machine machine;
+    ASSERT_THROW(machine.EnableTrace(16), std::logic_error);
+}
+#endif
+
+// Trace files record at every trace level, so they can stay on in release builds
+TEST(TestTrace, TestMachineRecordsTraceFile) {
+    const std::string path = TempPath("chip8_machine_trace_test.bin");
+    {
+        TChip8Machine machine;
+        const uint8_t program[] = {0x60, 0x05, 0xA3, 0x00, 0x12, 0x04};
+        std::copy(std::begin(program), std::end(program), machine.State.Memory.begin() + 0x200);
+        machine.EnableTraceFile(path);
+        machine.Run(4);
+    }
+
+    const TTraceFileReader reader(path);
+    ASSERT_EQ(4u, reader.Size());
+    ASSERT_EQ(0x200, reader[0].PC);
+    ASSERT_EQ(0x6005, reader[0].Word);
+    ASSERT_EQ(0x204, reader[3].PC);
+}
+
+TEST(TestTrace, TestFileRoundTrip) {
+    const std::string path = TempPath("chip8_trace_test.bin");
+    {
+        TTraceFileWriter writer(path);
+        for (uint64_t cycle = 1; cycle <= 1000; ++cycle) {
+            TTraceRecord record = {};
+            record.Cycle = cycle;
+            record.PC = 0x200 + 2 * (cycle % 16);
+            record.Word = 0x6005;
+            record.Register = TTraceRecord::NoRegister;
+            writer.Push(record);
+        }
+    }
+
+    const TTraceFileReader reader(path);
+    ASSERT_EQ(1000u, reader.Size());
+    ASSERT_EQ(1u, reader[0].Cycle);
+    ASSERT_EQ(1000u, reader[999].Cycle);
+    ASSERT_EQ(0x210, reader[999].PC);
+    ASSERT_EQ("LD V0, 5", Disassemble(TOpcodeParser::Parse(reader[999].Word)));
+}
+
+TEST(TestTrace, TestFileStopsWhenItCantGrow) {
+    const std::string path = TempPath("chip8_trace_full_test.bin");
+    rlimit limit;
+    ASSERT_EQ(0, getrlimit(RLIMIT_FSIZE, &limit));
+    const rlimit small = {24 << 20, limit.rlim_max};
+    const auto oldHandler = std::signal(SIGXFSZ, SIG_IGN);
+    ASSERT_EQ(0, setrlimit(RLIMIT_FSIZE, &small));
+
+    uint64_t written = 0;
+    {
+        // The second 16 MiB chunk exceeds the limit: pushing goes on, without recording
+        TTraceFileWriter writer(path);
+        TTraceRecord record = {};
+        for (uint64_t cycle = 1; cycle <= (2 << 20); ++cycle) {
+            record.Cycle = cycle;
+            writer.Push(record);
+        }
+        written = writer.GetCount();
+    }
+    setrlimit(RLIMIT_FSIZE, &limit);
+    std::signal(SIGXFSZ, oldHandler);
+
+    ASSERT_GT(written, 0u);
+    ASSERT_LT(written, uint64_t(2 << 20));
+    const TTraceFileReader reader(path);
+    ASSERT_EQ(written, reader.Size());
+    ASSERT_EQ(written, reader[reader.Size() - 1].Cycle);
+}
+
+TEST(TestCounters, TestCountsPerOperationAndAddress) {
+    for (const auto backend : {TChip8Machine::ECpuBackend::Dispatch, TChip8Machine::ECpuBackend::Threaded,
+                               TChip8Machine::ECpuBackend::Blocks})
+    {
+        TChip8Machine machine;
+        machine.SetCpuBackend(backend);
+        // LD V0, 05; ADD V0, 01; JP 202
+        const uint8_t program[] = {0x60, 0x05, 0x70, 0x01, 0x12, 0x02};
+        std::copy(std::begin(program), std::end(program), machine.State.Memory.begin() + 0x200);
+        machine.EnableCounters();
+        machine.Run(21);
+
+        const auto& counters = *machine.GetCounters();
+        ASSERT_EQ(1u, counters.Operations[static_cast<size_t>(EOperationType::LD_CONST)]);
+        ASSERT_EQ(10u, counters.Operations[static_cast<size_t>(EOperationType::ADD_CONST)]);
+        ASSERT_EQ(10u, counters.Operations[static_cast<size_t>(EOperationType::JUMP)]);
+        ASSERT_EQ(1u, counters.Addresses[0x200]);
+        ASSERT_EQ(10u, counters.Addresses[0x202]);
+        ASSERT_EQ(10u, counters.Addresses[0x204]);
+    }
+}
+
+TEST(TestCounters, TestCsvAndJson) {
+    TExecutionCounters counters;
+    counters.Count(EOperationType::DRAW, 0x20A);
+    counters.Count(EOperationType::DRAW, 0x20A);
+
+    std::ostringstream csv;
+    counters.WriteCsv(csv);
+    ASSERT_EQ("kind,key,count\noperation,DRAW,2\npc,20A,2\n", csv.str());
+
+    std::ostringstream json;
+    counters.WriteJson(json);
+    ASSERT_EQ("{\"operations\": {\"DRAW\": 2}, \"pcs\": {\"20A\": 2}}\n", json.str());
+}
+
+TEST(TestSampler, TestSamplesChargeTheCallStack) {
+    TChip8Machine machine;
+    // 200: CALL 206; 202: JP 200; 206: CALL 20A; 208: RET; 20A: DRW V0, V0, 1; 20C: RET
+    const uint8_t program[] = {0x22, 0x06, 0x12, 0x00, 0x00, 0x00, 0x22, 0x0A, 0x00, 0xEE, 0xD0, 0x01, 0x00, 0xEE};
+    std::copy(std::begin(program), std::end(program), machine.State.Memory.begin() + 0x200);
+    machine.EnableSampling(std::chrono::hours(1));
+    auto& sampler = *machine.Sampler;
+
+    // Raised while DRW runs, taken at the RET after it
+    machine.Run(3);
+    sampler.Due = true;
+    machine.Run(1);
+    ASSERT_EQ(1u, sampler.GetSamplesCount());
+
+    // Raised while the outer RET runs
+    machine.Run(1);
+    sampler.Due = true;
+    machine.Run(1);
+    sampler.Discard();
+
+    std::ostringstream folded;
+    sampler.WriteFolded(folded);
+    ASSERT_EQ("main;RET 1\nmain;sub_206;sub_20A;DRAW 1\n", folded.str());
+}
+
+TEST(TestSampler, TestTimerTakesSamples) {
+    TChip8Machine machine;
+    const uint8_t program[] = {0x70, 0x01, 0x12, 0x00};
+    std::copy(std::begin(program), std::end(program), machine.State.Memory.begin() + 0x200);
+    machine.EnableSampling(std::chrono::microseconds(100));
+    for (size_t i = 0; i < 1000 && machine.GetSampler()->GetSamplesCount() == 0; ++i) {
+        machine.Run(100000);
+    }
+    ASSERT_GT(machine.GetSampler()->GetSamplesCount(), 0u);
+}
+
+namespace {
+    size_t CountOccurrences(const std::string& text, const std::string& what) {
+        size_t count = 0;
+        for (size_t pos = text.find(what); pos != std::string::npos; pos = text.find(what, pos + 1)) {
+            ++count;
+        }
+        return count;
+    }
+}
+
+TEST(TestEventTracer, TestMachineRecordsTicksAndDraws) {
+    TEventTracer events;
+    TChip8Machine machine;
+    // DRW V0, V0, 1; JP 200
+    const uint8_t program[] = {0xD0, 0x01, 0x12, 0x00};
+    std::copy(std::begin(program), std::end(program), machine.State.Memory.begin() + 0x200);
+    machine.SetEventTracer(&events);
+    machine.SetSpeed(TChip8Machine::Unthrottled);
+    machine.Execute(3);
+
+    std::thread other([&events]() {
+        events.SetThreadName("other \"thread\"");
+        TEventScope scope(&events, "Work");
+    });
+    other.join();
+
+    std::ostringstream json;
+    events.Write(json);
+    const std::string trace = json.str();
+    ASSERT_EQ(0u, trace.find("{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n"));
+    ASSERT_EQ(2u, CountOccurrences(trace, "\"thread_name\""));
+    ASSERT_EQ(1u, CountOccurrences(trace, "\"name\": \"cpu\""));
+    ASSERT_EQ(1u, CountOccurrences(trace, "\"name\": \"other \\\"thread\\\"\""));
+    ASSERT_EQ(3u, CountOccurrences(trace, "\"name\": \"Run\""));
+    ASSERT_EQ(3u, CountOccurrences(trace, "\"name\": \"Timer tick\""));
+    ASSERT_EQ(15u, CountOccurrences(trace, "\"name\": \"Draw\""));
+    ASSERT_EQ(1u, CountOccurrences(trace, "\"name\": \"Work\", \"pid\": 1, \"tid\": 2"));
+}
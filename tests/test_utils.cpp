@@ -1,5 +1,9 @@
 #include <gtest/gtest.h>
+#include <thread>
 #include <utils/bitutils.h>
+#include <utils/fixed_containers.h>
+#include <utils/triple_buffer.h>
+#include <utils/work_stealing_pool.h>
 
 TEST(TestBitutils, TestGetOctetAt) {
     ASSERT_EQ(0xD, GetOctetAt<1>(0xABCD));
@@ -25,3 +29,114 @@ TEST(TestBitutils, TestGetOctetsRange) {
     ASSERT_EQ(sizeof(uint16_t), sizeof(GetOctetsRange<1,3>(0xABCD)));
     ASSERT_EQ(sizeof(uint16_t), sizeof(GetOctetsRange<1,4>(0xABCD)));
 }
+
+
+TEST(TestBitutils, TestConstexpr) {
+    static_assert(GetOctetsRange<1,3>(0xABCD) == 0xBCD, "GetOctetsRange must be usable at compile time");
+    static_assert(GetOctetAt<2>(0xABCD) == 0xC, "GetOctetAt must be usable at compile time");
+    static_assert(GetLastOctet(0xABCD) == 0xA, "GetLastOctet must be usable at compile time");
+}
+
+TEST(TestTripleBuffer, TestPublishAndUpdate) {
+    TTripleBuffer<int> buffer(0);
+    ASSERT_FALSE(buffer.Update());
+    ASSERT_EQ(0, buffer.Read());
+
+    buffer.Publish(1);
+    buffer.Publish(2);
+    ASSERT_TRUE(buffer.Update());
+    ASSERT_EQ(2, buffer.Read());
+    ASSERT_FALSE(buffer.Update());
+    ASSERT_EQ(2, buffer.Read());
+
+    buffer.Publish(3);
+    ASSERT_TRUE(buffer.Update());
+    ASSERT_EQ(3, buffer.Read());
+}
+
+TEST(TestTripleBuffer, TestConcurrentReadsAreConsistent) {
+    struct TFrame {
+        std::array<uint64_t, 32> Rows;
+    };
+
+    TFrame initial;
+    initial.Rows.fill(0);
+    TTripleBuffer<TFrame> buffer(initial);
+
+    std::thread writer([&buffer]() {
+        TFrame frame;
+        for (uint64_t i = 1; i <= 20000; ++i) {
+            frame.Rows.fill(i);
+            buffer.Publish(frame);
+        }
+    });
+
+    uint64_t last = 0;
+    while (last != 20000) {
+        buffer.Update();
+        const auto& frame = buffer.Read();
+        for (auto row : frame.Rows) {
+            ASSERT_EQ(frame.Rows.front(), row);
+        }
+        ASSERT_GE(frame.Rows.front(), last);
+        last = frame.Rows.front();
+    }
+    writer.join();
+}
+
+TEST(TestWorkStealingPool, TestRunsEveryTask) {
+    std::atomic<uint64_t> sum {0};
+    TWorkStealingPool pool(4);
+    for (uint64_t i = 1; i <= 1000; ++i) {
+        pool.Submit([&sum, i]() { sum += i; });
+    }
+    pool.Wait();
+    ASSERT_EQ(500500u, sum);
+}
+
+TEST(TestWorkStealingPool, TestNestedSubmitAndErrors) {
+    std::atomic<int> done {0};
+    TWorkStealingPool pool(3);
+    for (int i = 0; i < 10; ++i) {
+        pool.Submit([&pool, &done]() {
+            for (int j = 0; j < 10; ++j) {
+                pool.Submit([&done]() { ++done; });
+            }
+        });
+    }
+    pool.Wait();
+    ASSERT_EQ(100, done);
+
+    pool.Submit([]() { throw std::runtime_error("boom"); });
+    ASSERT_THROW(pool.Wait(), std::runtime_error);
+    pool.Submit([&done]() { ++done; });
+    pool.Wait();
+    ASSERT_EQ(101, done);
+}
+
+TEST(TestFixedContainers, TestStackIsBounded) {
+    TFixedStack<uint16_t, 2> stack = {};
+    stack.push(1);
+    stack.push(2);
+    ASSERT_TRUE(stack.full());
+    ASSERT_THROW(stack.push(3), std::overflow_error);
+    ASSERT_EQ(2, stack.top());
+    stack.pop();
+    stack.pop();
+    ASSERT_THROW(stack.pop(), std::underflow_error);
+    ASSERT_THROW(stack.top(), std::underflow_error);
+}
+
+TEST(TestFixedContainers, TestQueueDropsOldestWhenFull) {
+    TFixedQueue<uint8_t, 4> queue = {};
+    for (uint8_t value = 1; value <= 6; ++value) {
+        queue.push(value);
+    }
+    ASSERT_EQ(4u, queue.size());
+    ASSERT_EQ(3, queue.front());
+    ASSERT_EQ(6, queue[3]);
+    queue.pop();
+    queue.push(7);
+    ASSERT_EQ(4, queue.front());
+    ASSERT_EQ(7, queue[3]);
+}